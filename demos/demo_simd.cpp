@@ -43,6 +43,21 @@ SIMD<double,2> testHSum (SIMD<double,4> a, SIMD<double,4> b)
   return hSum(a,b);
 }
 
+SIMD<double,4> testHSum4 (SIMD<double,4> a0, SIMD<double,4> a1, SIMD<double,4> a2, SIMD<double,4> a3)
+{
+  return hSum(a0,a1,a2,a3);
+}
+
+auto testPermute (SIMD<double,4> a)
+{
+  return permute<1,0,3,2>(a);
+}
+
+void testTranspose (SIMD<double,4> & a0, SIMD<double,4> & a1, SIMD<double,4> & a2, SIMD<double,4> & a3)
+{
+  transpose(a0,a1,a2,a3);
+}
+
 
 
 int main()
@@ -56,6 +71,19 @@ int main()
 
   cout << "HSum(a) = " << hSum(a) << endl;
   cout << "HSum(a,b) = " << hSum(a,b) << endl;
+  cout << "HSum(a,b,a,b) = " << hSum(a,b,a,b) << endl;
+
+  cout << "permute<1,0,3,2>(a) = " << permute<1,0,3,2>(a) << endl;
+  cout << "blend<0b0101>(a,b) = " << blend<0b0101>(a,b) << endl;
+  cout << "broadcast<2>(a) = " << broadcast<2>(a) << endl;
+  cout << "reverse(a) = " << reverse(a) << endl;
+  cout << "rotate<1>(a) = " << rotate<1>(a) << endl;
+
+  {
+    SIMD<double,4> r0 = a, r1 = 10.0*a, r2 = 100.0*a, r3 = 1000.0*a;
+    transpose(r0, r1, r2, r3);
+    cout << "transpose = " << endl << r0 << endl << r1 << endl << r2 << endl << r3 << endl;
+  }
 
   
   auto sequ = IndexSequence<int64_t, 4>();
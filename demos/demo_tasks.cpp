@@ -1,5 +1,7 @@
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <vector>
 
 
 #include <taskmanager.hpp>
@@ -12,7 +14,11 @@ using std::cout, std::endl;
 int main()
 {
   timeline = std::make_unique<TimeLine>("demo.trace");
+  ProfileOptions profile_options;
+  profile_options.calltree = true;
+  profile = std::make_unique<Profile>(profile_options);
 
+  SetTaskInstrumentation ({ true, true });
   StartWorkers(3);
   
   RunParallel(10, [] (int i, int size)
@@ -56,6 +62,18 @@ int main()
       });
   }
 
+
+  {
+    static Timer t("100 barriers in a parallel region", { 0, 0, 1});
+    RegionTimer reg(t);
+
+    ParallelRegion (0, [] (Team & team)
+    {
+      for (int k = 0; k < 100; k++)
+        team.barrier();
+    });
+  }
+
   
   {
     static Timer t("10x10x10 parallel runs", { 0, 0, 1});
@@ -88,7 +106,62 @@ int main()
   });
 
 
+  {
+    static Timer t("ParallelFor over 10^6 entries", { 0, 1, 1});
+    RegionTimer reg(t);
+
+    std::vector<double> x(1000000);
+    ParallelFor (x.size(), [&x] (T_Range<size_t> r)
+    {
+      for (size_t i : r)
+        x[i] = i;
+    });
+  }
+
+
+  {
+    // two independent 2-stage chains, joined by a last stage
+    static Timer tstage("pipeline stage", { 1, 0, 1});
+    auto stage = [] ()
+    {
+      RegionTimer reg(tstage);
+      ParallelFor (100000, [] (T_Range<size_t> r) { });
+    };
+
+    TaskGraph graph;
+    auto a = graph.add(stage).then(stage);
+    auto b = graph.add(stage).then(stage);
+    graph.add(stage, { a, b });
+
+    for (int step = 0; step < 10; step++)
+      graph.run();
+  }
+
+  {
+    // start a job, overlap it with a second one, then wait for the first
+    auto handle = RunParallelAsync (20, [] (int i, int size)
+    {
+      static Timer t("async task", { 1, 1, 0});
+      RegionTimer reg(t);
+    });
+
+    RunParallel (20, [] (int i, int size)
+    {
+      static Timer t("overlapping task", { 0, 1, 0});
+      RegionTimer reg(t);
+    });
+
+    cout << "async job done before waiting: " << handle.test() << endl;
+    handle.wait();
+  }
   
   StopWorkers();
+  PrintTaskStatistics (cout);
+  profile->print (cout);
+  profile->printHotspots (cout, 5);
+
+  // flamegraph.pl demo.folded > demo.svg
+  std::ofstream folded("demo.folded");
+  profile->writeCollapsedStacks (folded);
 }
 
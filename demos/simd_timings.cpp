@@ -1,9 +1,13 @@
 #include <iostream>
 #include <sstream>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 
 
 #include <simd.hpp>
+#include <simd_math.hpp>
+#include <simd_loop.hpp>
 
 using namespace ASC_HPC;
 using namespace std;
@@ -18,13 +22,13 @@ using namespace std;
 void daxpy (size_t n, double * px, double * py, double alpha)
 {
   SIMD<double> simd_alpha(alpha);
-  for (size_t i = 0; i < n; i += SIMD<double>::size())
-    {
-      SIMD<double> yi(py+i);
-      // yi += simd_alpha * SIMD<double> (px+i);
-      yi = fma(simd_alpha, SIMD<double> (px+i), yi);
-      yi.store(py+i);
-    }
+  simdLoop<SIMD<double>::size()> (n, [&](size_t i, auto mask)
+  {
+    SIMD<double> yi = load(py+i, mask);
+    // yi += simd_alpha * load(px+i, mask);
+    yi = fma(simd_alpha, load(px+i, mask), yi);
+    store(py+i, yi, mask);
+  });
 }
 
 // multi-daxpy:
@@ -38,25 +42,49 @@ void daxpy2x2 (size_t n, double * px0, double * px1,
   SIMD<double> simd_alpha10(alpha10);
   SIMD<double> simd_alpha11(alpha11);  
   
-  for (size_t i = 0; i < n; i += SIMD<double>::size())
-    {
-      SIMD<double> xi0(px0+i);
-      SIMD<double> xi1(px1+i);
-      // (SIMD<double>(py0+i)+simd_alpha00*xi0+simd_alpha01*xi1).store(py0+i);
-      // (SIMD<double>(py1+i)+simd_alpha10*xi0+simd_alpha11*xi1).store(py1+i);
-
-      SIMD<double> yi0(py0+i);
-      yi0 = fma(simd_alpha00, xi0, yi0);
-      yi0 = fma(simd_alpha01, xi1, yi0);
-      yi0.store(py0+i);
-      
-      SIMD<double> yi1(py1+i);
-      yi1 = fma(simd_alpha10, xi0, yi1);
-      yi1 = fma(simd_alpha11, xi1, yi1);
-      yi1.store(py1+i);
-    }
+  simdLoop<SIMD<double>::size()> (n, [&](size_t i, auto mask)
+  {
+    SIMD<double> xi0 = load(px0+i, mask);
+    SIMD<double> xi1 = load(px1+i, mask);
+    // (SIMD<double>(py0+i)+simd_alpha00*xi0+simd_alpha01*xi1).store(py0+i);
+    // (SIMD<double>(py1+i)+simd_alpha10*xi0+simd_alpha11*xi1).store(py1+i);
+
+    SIMD<double> yi0 = load(py0+i, mask);
+    yi0 = fma(simd_alpha00, xi0, yi0);
+    yi0 = fma(simd_alpha01, xi1, yi0);
+    store(py0+i, yi0, mask);
+
+    SIMD<double> yi1 = load(py1+i, mask);
+    yi1 = fma(simd_alpha10, xi0, yi1);
+    yi1 = fma(simd_alpha11, xi1, yi1);
+    store(py1+i, yi1, mask);
+  });
 }
 
+// indirect daxpy, as in sparse matrix kernels: y += alpha * x[ind]
+void daxpyIndirect (size_t n, double * px, int64_t * pind, double * py, double alpha)
+{
+  SIMD<double> simd_alpha(alpha);
+  simdLoop<SIMD<double>::size()> (n, [&](size_t i, auto mask)
+  {
+    SIMD<double> yi = load(py+i, mask);
+    yi = fma(simd_alpha, gather(px, load(pind+i, mask), mask), yi);
+    store(py+i, yi, mask);
+  });
+}
+
+// dot product with UNROLL independent accumulators
+template <size_t UNROLL>
+double Dot (size_t n, double * px, double * py)
+{
+  constexpr size_t SW = SIMD<double>::size();
+  auto sum = simdReduce<SW,UNROLL> (n, SIMD<double,SW>(0.0),
+                                    [&](size_t i, auto mask, SIMD<double,SW> & acc)
+                                    { acc = fma(load(px+i, mask), load(py+i, mask), acc); });
+  return hSum(sum);
+}
+
+
 
 /*
   useful functions for matrix-matrix multiplication with inner products:
@@ -105,12 +133,70 @@ auto InnerProduct2 (size_t n, double * px0, double * px1, double * py, size_t dy
 
 
 
+/*
+  vectorized elementary functions versus scalar libm:
+  time per evaluation and max. error in ulp
+ */
+
+double UlpDistance (double a, double b)
+{
+  if (a == b || (std::isnan(a) && std::isnan(b))) return 0;
+  int64_t ia, ib;
+  memcpy (&ia, &a, sizeof(a));
+  memcpy (&ib, &b, sizeof(b));
+  if (ia < 0) ia = INT64_MIN - ia;
+  if (ib < 0) ib = INT64_MIN - ib;
+  return std::abs(double(ia-ib));
+}
+
+template <typename FSIMD, typename FSCAL>
+void TimeFunction (string name, FSIMD fsimd, FSCAL fscal, double lo, double hi)
+{
+  size_t n = 1024;
+  double * px = new double[n];
+  double * py = new double[n];
+  double * pref = new double[n];
+  for (size_t i = 0; i < n; i++)
+    px[i] = lo + (hi-lo)*i/n;
+
+  size_t runs = size_t (1e7 / n) + 1;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t r = 0; r < runs; r++)
+    for (size_t i = 0; i < n; i += SIMD<double>::size())
+      fsimd(SIMD<double>(px+i)).store(py+i);
+  auto end = std::chrono::high_resolution_clock::now();
+  double time_simd = std::chrono::duration<double>(end-start).count();
+
+  start = std::chrono::high_resolution_clock::now();
+  for (size_t r = 0; r < runs; r++)
+    for (size_t i = 0; i < n; i++)
+      pref[i] = fscal(px[i]);
+  end = std::chrono::high_resolution_clock::now();
+  double time_scal = std::chrono::duration<double>(end-start).count();
+
+  double maxerr = 0;
+  for (size_t i = 0; i < n; i++)
+    maxerr = std::max(maxerr, UlpDistance(py[i], pref[i]));
+
+  cout << name << " on [" << lo << "," << hi << "]: simd = "
+       << time_simd/(n*runs)*1e9 << " ns, libm = "
+       << time_scal/(n*runs)*1e9 << " ns, speedup = " << time_scal/time_simd
+       << ", max err = " << maxerr << " ulp" << endl;
+
+  delete [] pref;
+  delete [] py;
+  delete [] px;
+}
+
+
+
 
 int main()
 {
 
   cout << "timing daxpy" << endl;  
-  for (size_t n = 16; n <= 1024; n*= 2)
+  for (size_t n = 16; n <= 1024; n = 3*n/2+1)
     {
       double * px = new double[n];
       double * py = new double[n];
@@ -138,6 +224,41 @@ int main()
     }
 
 
+  cout << "timing dot product, 1 and 4 accumulators" << endl;
+  for (size_t n = 16; n <= 1024; n = 3*n/2+1)
+    {
+      double * px = new double[n];
+      double * py = new double[n];
+      for (size_t i = 0; i < n; i++)
+        {
+          px[i] = i;
+          py[i] = 2;
+        }
+
+      size_t runs = size_t (1e8 / n) + 1;
+      double sum = 0;
+
+      auto start = std::chrono::high_resolution_clock::now();
+      for (size_t i = 0; i < runs; i++)
+        sum += Dot<1> (n, px, py);
+      auto end = std::chrono::high_resolution_clock::now();
+      double time1 = std::chrono::duration<double>(end-start).count();
+
+      start = std::chrono::high_resolution_clock::now();
+      for (size_t i = 0; i < runs; i++)
+        sum += Dot<4> (n, px, py);
+      end = std::chrono::high_resolution_clock::now();
+      double time4 = std::chrono::duration<double>(end-start).count();
+
+      cout << "n = " << n << ", GFlops = " << (2*n*runs)/time1*1e-9
+           << ", unrolled GFlops = " << (2*n*runs)/time4*1e-9
+           << ", sum = " << sum << endl;
+
+      delete [] py;
+      delete [] px;
+    }
+
+
   cout << "timing daxpy 2x2" << endl;
   for (size_t n = 16; n <= 1024; n*= 2)
     {
@@ -174,6 +295,38 @@ int main()
 
   
 
+  cout << "timing indirect daxpy" << endl;
+  for (size_t n = 16; n <= 1024; n*= 2)
+    {
+      double * px = new double[n];
+      double * py = new double[n];
+      int64_t * pind = new int64_t[n];
+      for (size_t i = 0; i < n; i++)
+        {
+          px[i] = i;
+          py[i] = 2;
+          pind[i] = (7*i) % n;
+        }
+
+      auto start = std::chrono::high_resolution_clock::now();
+
+      size_t runs = size_t (1e8 / n) + 1;
+
+      for (size_t i = 0; i < runs; i++)
+        daxpyIndirect (n, px, pind, py, 2.8);
+
+      auto end = std::chrono::high_resolution_clock::now();
+      double time = std::chrono::duration<double>(end-start).count();
+
+      cout << "n = " << n << ", time = " << time << " s, GFlops = "
+           << (n*runs)/time*1e-9 << endl;
+
+      delete [] pind;
+      delete [] py;
+      delete [] px;
+    }
+
+
   constexpr size_t SW=4;
   cout << "timing inner product 1x" << SW << endl;
   for (size_t n = 16; n <= 1024; n*= 2)
@@ -244,4 +397,13 @@ int main()
     }
   }
   
+
+
+  cout << "timing elementary functions, time per evaluation" << endl;
+  TimeFunction ("exp", [](auto x) { return exp(x); }, [](double x) { return std::exp(x); }, -700, 700);
+  TimeFunction ("log", [](auto x) { return log(x); }, [](double x) { return std::log(x); }, 1e-300, 1e300);
+  TimeFunction ("sin", [](auto x) { return sin(x); }, [](double x) { return std::sin(x); }, -1e5, 1e5);
+  TimeFunction ("cos", [](auto x) { return cos(x); }, [](double x) { return std::cos(x); }, -1e5, 1e5);
+  TimeFunction ("pow(x,2.5)", [](auto x) { return pow(x, decltype(x)(2.5)); },
+                [](double x) { return std::pow(x, 2.5); }, 0, 100);
 }
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <vector>
+#include <cmath>
+
+
+#include <simd.hpp>
+#include <gemm.hpp>
+
+using namespace ASC_HPC;
+using namespace std;
+
+
+// fma throughput of one core: enough independent chains to hide the latency
+double PeakGFlops ()
+{
+  constexpr size_t SW = SIMD<double>::size();
+  constexpr size_t CHAINS = 12;
+  SIMD<double,CHAINS*SW> acc(1.0);
+  SIMD<double,CHAINS*SW> a(0.999999), b(1e-6);
+
+  size_t runs = 100*1000*1000 / SW;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < runs; i++)
+    acc = fma(acc, a, b);
+  auto end = std::chrono::high_resolution_clock::now();
+  double time = std::chrono::duration<double>(end-start).count();
+
+  if (hSum(acc) == 42) cout << "fooling the optimizer" << endl;
+  return 2*CHAINS*SW*runs / time * 1e-9;
+}
+
+
+// C = alpha*op(A)*op(B) + beta*C, the straight-forward way
+void gemmReference (Layout layout, Op opA, Op opB, size_t M, size_t N, size_t K,
+                    double alpha, const double * A, size_t lda, const double * B, size_t ldb,
+                    double beta, double * C, size_t ldc)
+{
+  auto entry = [layout] (const double * p, size_t ld, Op op, size_t i, size_t j)
+  {
+    if (op == Op::Trans) swap(i,j);
+    return (layout == Layout::RowMajor) ? p[i*ld+j] : p[i+j*ld];
+  };
+  for (size_t i = 0; i < M; i++)
+    for (size_t j = 0; j < N; j++)
+      {
+        double sum = 0;
+        for (size_t k = 0; k < K; k++)
+          sum += entry(A, lda, opA, i, k) * entry(B, ldb, opB, k, j);
+        double & cij = (layout == Layout::RowMajor) ? C[i*ldc+j] : C[i+j*ldc];
+        cij = alpha*sum + beta*cij;
+      }
+}
+
+
+int main()
+{
+  cout << "checking all layouts and transpositions against reference" << endl;
+  for (auto layout : { Layout::RowMajor, Layout::ColMajor })
+    for (auto opA : { Op::NoTrans, Op::Trans })
+      for (auto opB : { Op::NoTrans, Op::Trans })
+        {
+          size_t M = 37, N = 53, K = 301, ld = 310;
+          vector<double> A(ld*ld), B(ld*ld), C(ld*ld), Cref(ld*ld);
+          for (size_t i = 0; i < A.size(); i++)
+            {
+              A[i] = sin(i);
+              B[i] = cos(i);
+              C[i] = Cref[i] = 1.0/(i+1);
+            }
+
+          gemm (layout, opA, opB, M, N, K, 0.5, A.data(), ld, B.data(), ld, 2.0, C.data(), ld);
+          gemmReference (layout, opA, opB, M, N, K, 0.5, A.data(), ld, B.data(), ld, 2.0, Cref.data(), ld);
+
+          double err = 0;
+          for (size_t i = 0; i < C.size(); i++)
+            err = max(err, fabs(C[i]-Cref[i]));
+          cout << (layout == Layout::RowMajor ? "row-major" : "col-major")
+               << (opA == Op::Trans ? ", A^T" : ", A  ")
+               << (opB == Op::Trans ? ", B^T" : ", B  ")
+               << ": err = " << err << endl;
+        }
+
+
+  double peak = PeakGFlops();
+  cout << "peak (measured fma throughput) = " << peak << " GFlops" << endl;
+
+  cout << "timing C = A*B, row-major n x n" << endl;
+  for (size_t n = 64; n <= 2048; n *= 2)
+    {
+      vector<double> A(n*n, 1.0), B(n*n, 2.0), C(n*n);
+
+      size_t runs = size_t (1e10 / (2.0*n*n*n)) + 1;
+
+      auto start = std::chrono::high_resolution_clock::now();
+      for (size_t i = 0; i < runs; i++)
+        gemm (n, n, n, A.data(), n, B.data(), n, C.data(), n);
+      auto end = std::chrono::high_resolution_clock::now();
+      double time = std::chrono::duration<double>(end-start).count();
+
+      double gflops = 2.0*n*n*n*runs / time * 1e-9;
+      cout << "n = " << n << ", time = " << time << " s, GFlops = " << gflops
+           << ", " << 100*gflops/peak << " % of peak" << endl;
+    }
+}
@@ -3,9 +3,14 @@
 #include <iostream>
 #include <sstream>
 #include <chrono>
+#include <thread>
+#include <algorithm>
 
 
 #include <simd.hpp>
+#include <aligned_vector.hpp>
+#include <taskmanager.hpp>
+#include <timer.hpp>
 
 using namespace ASC_HPC;
 using namespace std;
@@ -29,10 +34,135 @@ auto Inner (size_t n, SIMD<double,32> * x, SIMD<double,32> * y)
 }
 
 
-void Triade (size_t n, SIMD<double,16> * a, SIMD<double,16> * b, SIMD<double,16> * c)
+void Triade (size_t n, const double * a, const double * b, double * c)
 {
-  for (size_t i = 0; i < n; i++)
-    c[i] += a[i]+b[i];
+  constexpr size_t SW = 16;
+  for (size_t i = 0; i < n; i += SW)
+    (SIMD<double,SW>::loadAligned(c+i) + SIMD<double,SW>::loadAligned(a+i)
+     + SIMD<double,SW>::loadAligned(b+i)).storeAligned(c+i);
+}
+
+// c = a+b, regular stores first read c into the cache (write-allocate)
+void TriadeStore (size_t n, const double * a, const double * b, double * c)
+{
+  constexpr size_t SW = 16;
+  for (size_t i = 0; i < n; i += SW)
+    (SIMD<double,SW>::loadAligned(a+i) + SIMD<double,SW>::loadAligned(b+i)).storeAligned(c+i);
+}
+
+// c = a+b, non-temporal stores bypass the cache and save the read of c
+void TriadeStream (size_t n, const double * a, const double * b, double * c)
+{
+  constexpr size_t SW = 16;
+  for (size_t i = 0; i < n; i += SW)
+    (SIMD<double,SW>::loadAligned(a+i) + SIMD<double,SW>::loadAligned(b+i)).storeStream(c+i);
+  streamFence();
+}
+
+
+/*
+  c = a+b with all threads, each on its fixed part of the arrays.
+  The arrays are either initialized by the main thread (all pages on
+  its NUMA node) or first-touched in parallel (pages next to the
+  thread computing on them), with unpinned or scattered threads.
+*/
+void TimeTriadeParallel ()
+{
+  int nthreads = std::max (1u, std::thread::hardware_concurrency());
+  size_t n = size_t(1) << 25;
+  constexpr size_t SW = 16;
+
+  cout << "parallel c = a+b, " << nthreads << " threads, "
+       << 3*n*sizeof(double)/1e6 << " MB" << endl;
+
+  for (auto policy : { AffinityPolicy::None, AffinityPolicy::Scatter })
+    for (bool firsttouch : { false, true })
+      {
+        StartWorkers (nthreads-1, IdleStrategy(), ThreadAffinity{policy, {}});
+
+        AlignedAllocator<double> alloc;
+        double * a = alloc.allocate(n);
+        double * b = alloc.allocate(n);
+        double * c = alloc.allocate(n);
+        if (firsttouch)
+          {
+            ParallelFirstTouch (a, n, 1.0);
+            ParallelFirstTouch (b, n, 2.0);
+            ParallelFirstTouch (c, n, 0.0);
+          }
+        else
+          for (size_t i = 0; i < n; i++)
+            {
+              a[i] = 1.0;
+              b[i] = 2.0;
+              c[i] = 0.0;
+            }
+
+        auto triade = [&] (int thread, int nthreads)
+        {
+          auto r = T_Range<size_t>(n/SW).split(thread, nthreads);
+          TriadeStore (SW*r.size(), a+SW*r.first(), b+SW*r.first(), c+SW*r.first());
+        };
+
+        RunOnEachThread (triade);  // warm-up
+        size_t runs = 10;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < runs; i++)
+          RunOnEachThread (triade);
+        auto end = std::chrono::high_resolution_clock::now();
+        double time = std::chrono::duration<double, std::nano>(end-start).count();
+
+        cout << (policy == AffinityPolicy::None ? "unpinned" : "scatter ")
+             << (firsttouch ? ", parallel first touch" : ", serial init         ")
+             << ", GB/sec = " << (3*n*sizeof(double)*runs)/time << endl;
+
+        alloc.deallocate(a, n);
+        alloc.deallocate(b, n);
+        alloc.deallocate(c, n);
+        StopWorkers();
+      }
+}
+
+
+/*
+  Inner and Triade with hardware counters, in L1 cache and from memory.
+  Low IPC with many bytes per flop means memory bound.
+*/
+void ProfileKernels ()
+{
+  ProfileOptions options;
+  options.hardware_counters = true;
+  profile = std::make_unique<Profile>(options);
+
+  struct Size { const char * name; size_t n; };
+  for (auto [name, n] : { Size{"16 kB", 64}, Size{"64 MB", size_t(1) << 18} })
+    {
+      // n SIMD<double,32> = 32*n doubles per array
+      std::vector<SIMD<double,32>> x(n, SIMD<double,32>(1.0)), y(n, SIMD<double,32>(1.0));
+      AlignedVector<double> a(32*n), b(32*n), c(32*n);
+      for (size_t i = 0; i < a.size(); i++)
+        a[i] = b[i] = c[i] = i;
+      size_t runs = 1e9 / (n*sizeof(SIMD<double,32>)) + 1;
+
+      Timer tinner(std::string("Inner, ")+name);
+      Timer ttriade(std::string("Triade, ")+name);
+
+      SIMD<double,32> sum(0.0);
+      {
+        RegionTimer reg(tinner);
+        for (size_t i = 0; i < runs; i++)
+          sum += Inner (n, x.data(), y.data());
+      }
+      {
+        RegionTimer reg(ttriade);
+        for (size_t i = 0; i < runs; i++)
+          Triade (c.size(), a.data(), b.data(), c.data());
+      }
+      cout << "sum = " << hSum(sum) << ", c[1] = " << c[1] << endl;
+    }
+
+  profile->print(cout);
+  profile.reset();
 }
 
 
@@ -110,43 +240,36 @@ int main()
   
   cout << "sum = " << hSum(sum) << endl;
 
-  if (false)
-  for (size_t n = 1; n <= 2<<22; n*=2)
+  // columns: mem, GB/sec for c += a+b, c = a+b, c = a+b with streaming stores,
+  // up to 3 x 128 MB
+  if (true)
+  for (size_t n = 1; n <= 1<<20; n*=2)
     {
-      SIMD<double,16> * pa = new SIMD<double,16>[n];
-      SIMD<double,16> * pb = new SIMD<double,16>[n];
-      SIMD<double,16> * pc = new SIMD<double,16>[n];
-
-      for (size_t i = 0; i < n; i++)
-        {
-          pa[i] = SIMD<double,16>(i);
-          pb[i] = SIMD<double,16>(i);
-        }
-      
-      size_t mem = 3*n*sizeof(SIMD<double,16>);
+      AlignedVector<double> a(16*n), b(16*n), c(16*n);
+      for (size_t i = 0; i < 16*n; i++)
+        a[i] = b[i] = c[i] = i;
 
+      size_t mem = 3*c.size()*sizeof(double);
       size_t runs = 1e10/mem+1;
 
-      auto start = std::chrono::high_resolution_clock::now();
-      
-      for (size_t i = 0; i < runs; i++)
-        Triade (n, pa, pb, pc);
-      
-      auto end = std::chrono::high_resolution_clock::now();
-
-      double time = std::chrono::duration<double, std::nano>(end-start).count();
-
-      /*
-      cout << "n = " << n << ", mem = " << mem << ", time = " << time 
-           << " ms, GB/sec = " << (mem*runs)/time
+      auto timeit = [&](auto kernel)
+      {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < runs; i++)
+          kernel();
+        auto end = std::chrono::high_resolution_clock::now();
+        double time = std::chrono::duration<double, std::nano>(end-start).count();
+        return (mem*runs)/time;
+      };
+
+      cout << mem
+           << " " << timeit([&]() { Triade (c.size(), a.data(), b.data(), c.data()); })
+           << " " << timeit([&]() { TriadeStore (c.size(), a.data(), b.data(), c.data()); })
+           << " " << timeit([&]() { TriadeStream (c.size(), a.data(), b.data(), c.data()); })
            << endl;
-      */
-      cout << mem << " " <<  (mem*runs)/time << endl;
-           
-      delete [] pc;
-      delete [] pb;
-      delete [] pa;
     }
 
-  
+  TimeTriadeParallel();
+
+  ProfileKernels();
 }
@@ -0,0 +1,261 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <ctime>
+#include <functional>
+
+#include <taskmanager.hpp>
+#include <parallel_algorithms.hpp>
+#include <simd_loop.hpp>
+
+using namespace ASC_HPC;
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+
+/*
+  wake-up latency: time from RunParallel until a worker starts a task,
+  after the pool was idle for a while (long enough to park).
+  The caller pops task 0 and waits there, so task 1 must be stolen.
+*/
+void TimeWakeUp (const char * name, IdleStrategy idle, int numthreads)
+{
+  StartWorkers(numthreads, idle);
+
+  vector<double> latency;
+  for (int run = 0; run < 200; run++)
+    {
+      std::this_thread::sleep_for (std::chrono::milliseconds(2));
+
+      std::atomic<bool> started{false};
+      Clock::time_point tstart;
+      auto tsubmit = Clock::now();
+      RunParallel (2, [&] (int i, int size)
+      {
+        if (i == 1)
+          {
+            tstart = Clock::now();
+            started = true;
+          }
+        else
+          while (!started) ;
+      });
+      latency.push_back (std::chrono::duration<double, std::micro>(tstart-tsubmit).count());
+    }
+  sort (latency.begin(), latency.end());
+
+  // cpu time burnt by the idle pool, in cores
+  auto wall0 = Clock::now();
+  clock_t cpu0 = clock();
+  std::this_thread::sleep_for (std::chrono::milliseconds(200));
+  double cpu = double(clock()-cpu0) / CLOCKS_PER_SEC;
+  double wall = std::chrono::duration<double>(Clock::now()-wall0).count();
+
+  StopWorkers();
+
+  cout << name
+       << ": wake-up median = " << latency[latency.size()/2] << " us"
+       << ", 90% = " << latency[latency.size()*9/10] << " us"
+       << ", max = " << latency.back() << " us"
+       << ", idle cpu load = " << cpu/wall << " cores" << endl;
+}
+
+
+// the type-erased path: a std::function per call, an indirect call per task
+void RunParallelStdFunction (int num, const std::function<void(int,int)> & func)
+{
+  RunParallel (num, func);
+}
+
+
+/*
+  startup overhead: a RunParallel with empty tasks, one per thread,
+  per-task overhead: many tiny tasks,
+  each for the templated RunParallel and the std::function one
+*/
+void TimeOverhead (int numthreads)
+{
+  StartWorkers(numthreads);
+
+  vector<double> y(100000, 0.0);
+  auto body = [&y] (int i, int size) { y[i] += 1; };
+
+  auto timeit = [&] (const char * name, int calls, int num, auto run)
+  {
+    run(num);  // warm-up
+    auto start = Clock::now();
+    for (int k = 0; k < calls; k++)
+      run(num);
+    double time = std::chrono::duration<double>(Clock::now()-start).count();
+    cout << name << ": " << 1e9*time/calls << " ns per call, "
+         << 1e9*time/(double(calls)*num) << " ns per task" << endl;
+  };
+
+  auto runTemplate = [&] (int num) { RunParallel (num, body); };
+  auto runStdFunction = [&] (int num) { RunParallelStdFunction (num, body); };
+
+  timeit ("template,      1 task     ", 100000, 1, runTemplate);
+  timeit ("std::function, 1 task     ", 100000, 1, runStdFunction);
+  timeit ("template,      task/thread", 10000, NumThreads(), runTemplate);
+  timeit ("std::function, task/thread", 10000, NumThreads(), runStdFunction);
+  timeit ("template,      10^5 tasks ", 10, y.size(), runTemplate);
+  timeit ("std::function, 10^5 tasks ", 10, y.size(), runStdFunction);
+
+  StopWorkers();
+}
+
+
+/*
+  many tiny parallel steps: a RunParallel per step,
+  versus one ParallelRegion with a barrier per step
+*/
+void TimeRegion (int numthreads)
+{
+  StartWorkers(numthreads);
+
+  int steps = 10000;
+  vector<double> y(NumThreads()*64, 0.0);
+
+  auto start = Clock::now();
+  for (int step = 0; step < steps; step++)
+    RunParallel (NumThreads(), [&] (int i, int size) { y[64*i] += 1; });
+  double time = std::chrono::duration<double>(Clock::now()-start).count();
+  cout << "RunParallel per step    : " << 1e9*time/steps << " ns per step" << endl;
+
+  start = Clock::now();
+  ParallelRegion (0, [&] (Team & team)
+  {
+    for (int step = 0; step < steps; step++)
+      {
+        y[64*team.rank()] += 1;
+        team.barrier();
+      }
+  });
+  time = std::chrono::duration<double>(Clock::now()-start).count();
+  cout << "ParallelRegion + barrier: " << 1e9*time/steps << " ns per step" << endl;
+
+  StopWorkers();
+}
+
+
+/*
+  fine-grained loop y[i] = 2*y[i]+1 over n entries:
+  one task per index, versus one range task per thread, versus ParallelFor
+*/
+void TimeParallelFor (int numthreads)
+{
+  StartWorkers(numthreads);
+
+  size_t n = 1000*1000;
+  vector<double> y(n, 1.0);
+
+  auto timeit = [&] (const char * name, auto func)
+  {
+    func();  // warm-up
+    int runs = 10;
+    auto start = Clock::now();
+    for (int k = 0; k < runs; k++)
+      func();
+    double time = std::chrono::duration<double>(Clock::now()-start).count() / runs;
+    cout << name << ": " << 1e9*time/n << " ns per entry" << endl;
+  };
+
+  timeit ("RunParallel, task per index ", [&] ()
+  {
+    RunParallel (n, [&] (int i, int size) { y[i] = 2*y[i]+1; });
+  });
+
+  timeit ("RunParallel, task per thread", [&] ()
+  {
+    RunParallel (NumThreads(), [&] (int i, int size)
+    {
+      for (size_t j : T_Range<size_t>(n).split(i, size))
+        y[j] = 2*y[j]+1;
+    });
+  });
+
+  timeit ("ParallelFor                 ", [&] ()
+  {
+    ParallelFor (n, [&] (T_Range<size_t> r)
+    {
+      for (size_t j : r)
+        y[j] = 2*y[j]+1;
+    });
+  });
+
+  StopWorkers();
+}
+
+
+/*
+  dot product with SIMD partial sums, and prefix sums, over 10^7 entries
+*/
+void TimeReduceScan (int numthreads)
+{
+  StartWorkers(numthreads);
+
+  constexpr size_t SW = SIMD<double>::size();
+  size_t n = 10*1000*1000;
+  AlignedVector<double> x(n, 1.0), y(n, 2.0), z(n);
+
+  auto timeit = [&] (const char * name, double bytes, auto func)
+  {
+    func();  // warm-up
+    int runs = 10;
+    auto start = Clock::now();
+    for (int k = 0; k < runs; k++)
+      func();
+    double time = std::chrono::duration<double>(Clock::now()-start).count() / runs;
+    cout << name << ": " << 1e3*time << " ms, " << bytes/time*1e-9 << " GB/s" << endl;
+  };
+
+  double dot = 0;
+  timeit ("ParallelReduce, dot product", 2*n*sizeof(double), [&] ()
+  {
+    auto sum = ParallelReduce (n, SIMD<double,SW>(0.0), [&] (T_Range<size_t> r)
+    {
+      const double * px = x.data()+r.first();
+      const double * py = y.data()+r.first();
+      return simdReduce<SW,4> (r.size(), SIMD<double,SW>(0.0),
+                               [&] (size_t i, auto mask, SIMD<double,SW> & acc)
+                               { acc = fma(load(px+i, mask), load(py+i, mask), acc); });
+    },
+    [] (SIMD<double,SW> a, SIMD<double,SW> b) { return a+b; });
+    dot = hSum(sum);
+  });
+
+  timeit ("ParallelPrefixSum          ", 3*n*sizeof(double), [&] ()
+  {
+    ParallelPrefixSum (n, x.data(), z.data());
+  });
+
+  cout << "dot = " << dot << ", last prefix sum = " << z[n-1] << endl;
+  StopWorkers();
+}
+
+
+int main()
+{
+  int numthreads = max (1, int(std::thread::hardware_concurrency())-1);
+  cout << "idle strategies, " << numthreads << " workers" << endl;
+
+  TimeWakeUp ("busy spin ", { IdlePolicy::BusySpin }, numthreads);
+  TimeWakeUp ("spin-yield", { IdlePolicy::SpinYield }, numthreads);
+  TimeWakeUp ("spin-park ", { IdlePolicy::SpinPark }, numthreads);
+  TimeWakeUp ("park early", { IdlePolicy::SpinPark, 10, 0 }, numthreads);
+
+  cout << "RunParallel overhead" << endl;
+  TimeOverhead (numthreads);
+
+  cout << "repeated fork-join" << endl;
+  TimeRegion (numthreads);
+
+  cout << "fine-grained parallel loop" << endl;
+  TimeParallelFor (numthreads);
+
+  cout << "reduction and scan" << endl;
+  TimeReduceScan (numthreads);
+}
@@ -0,0 +1,31 @@
+#include <iostream>
+#include <string>
+
+#include <timer.hpp>
+
+using namespace ASC_HPC;
+using std::cout, std::endl;
+
+
+/*
+  converts a trace written with TraceFormat::Binary:
+    trace_convert demo.bin demo.json     Chrome / Perfetto JSON
+    trace_convert demo.bin demo.paje     Paje, for any other extension
+*/
+int main(int argc, char ** argv)
+{
+  if (argc != 3)
+    {
+      cout << "usage: " << argv[0] << " binary_trace outfile[.json]" << endl;
+      return 1;
+    }
+
+  std::string outfile = argv[2];
+  bool json = outfile.size() >= 5 && outfile.compare(outfile.size()-5, 5, ".json") == 0;
+
+  if (!ConvertTrace (argv[1], outfile, json ? TraceFormat::Chrome : TraceFormat::Paje))
+    {
+      cout << "'" << argv[1] << "' is no binary trace" << endl;
+      return 1;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef ALIGNED_VECTOR_HPP
+#define ALIGNED_VECTOR_HPP
+
+#include <vector>
+#include <new>
+
+#include "simd.hpp"
+
+
+/*
+  allocator for cache-line aligned memory, such that
+  SIMD<T,S>::loadAligned, storeAligned and storeStream can be used
+  on the data, and vector entries don't share lines with other data
+ */
+
+
+namespace ASC_HPC
+{
+
+  constexpr size_t CacheLineSize = 64;
+
+  template <typename T, size_t ALIGN = std::max(CacheLineSize, alignof(T))>
+  class AlignedAllocator
+  {
+  public:
+    typedef T value_type;
+    template <typename T2> struct rebind { typedef AlignedAllocator<T2,ALIGN> other; };
+
+    AlignedAllocator() = default;
+    template <typename T2>
+    AlignedAllocator (const AlignedAllocator<T2,ALIGN> &) { }
+
+    T * allocate (size_t n)
+    { return static_cast<T*> (::operator new (n*sizeof(T), std::align_val_t(ALIGN))); }
+
+    void deallocate (T * p, size_t n)
+    { ::operator delete (p, std::align_val_t(ALIGN)); }
+  };
+
+  template <typename T1, typename T2, size_t ALIGN>
+  bool operator== (const AlignedAllocator<T1,ALIGN> &, const AlignedAllocator<T2,ALIGN> &) { return true; }
+  template <typename T1, typename T2, size_t ALIGN>
+  bool operator!= (const AlignedAllocator<T1,ALIGN> &, const AlignedAllocator<T2,ALIGN> &) { return false; }
+
+
+  template <typename T>
+  using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+
+  // a value on its own cache line, e.g. per-thread partial results
+  // written concurrently without false sharing
+  template <typename T>
+  struct alignas(CacheLineSize) alignas(T) CacheLinePadded
+  {
+    T value;
+  };
+
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <utility>
+
+#include "gemm.hpp"
+#include "simd.hpp"
+#include "aligned_vector.hpp"
+
+
+/*
+  blocked matrix-matrix product following Goto / BLIS:
+
+  loop over NC-wide column panels of B and C          (B panel in L3)
+    loop over KC-deep slices                          (packed B: kc x nc)
+      loop over MC-high row blocks of A               (packed A in L2)
+        loop over NR-wide micro-panels of packed B    (in L1)
+          loop over MR-high micro-panels of packed A
+            MR x NR register tile: C += A_panel * B_panel
+
+  The register tile is MR rows of SIMD<double,NR>, NR is three native
+  SIMD widths (4x12 on AVX2, 8x24 on AVX-512, 4x6 on SSE).
+*/
+
+
+namespace ASC_HPC
+{
+
+  namespace
+  {
+    constexpr size_t SW = SIMD<double>::size();
+    constexpr size_t NR = 3*SW;
+    constexpr size_t MR = (SW >= 8) ? 8 : 4;
+
+    constexpr size_t KC = 256;
+    constexpr size_t MC = 128;   // multiple of MR
+    constexpr size_t NC = 3072;  // multiple of NR
+
+
+    // entry (i,j) is at p[i*rs + j*cs]
+    struct StridedMatrix
+    {
+      const double * p;
+      size_t rs, cs;
+
+      double operator() (size_t i, size_t j) const { return p[i*rs+j*cs]; }
+      StridedMatrix block (size_t i, size_t j) const { return { p+i*rs+j*cs, rs, cs }; }
+      StridedMatrix trans () const { return { p, cs, rs }; }
+    };
+
+
+    // mc x kc block of A into MR-high row panels, k-major within the panel,
+    // scaled by alpha and zero-padded to a multiple of MR
+    void packA (size_t mc, size_t kc, StridedMatrix A, double alpha, double * Ap)
+    {
+      for (size_t i0 = 0; i0 < mc; i0 += MR)
+        {
+          size_t mr = std::min(MR, mc-i0);
+          for (size_t k = 0; k < kc; k++)
+            {
+              for (size_t i = 0; i < mr; i++)
+                Ap[i] = alpha * A(i0+i, k);
+              for (size_t i = mr; i < MR; i++)
+                Ap[i] = 0.0;
+              Ap += MR;
+            }
+        }
+    }
+
+    // kc x nc block of B into NR-wide column panels, zero-padded
+    void packB (size_t kc, size_t nc, StridedMatrix B, double * Bp)
+    {
+      for (size_t j0 = 0; j0 < nc; j0 += NR)
+        {
+          size_t nr = std::min(NR, nc-j0);
+          for (size_t k = 0; k < kc; k++)
+            {
+              if (nr == NR && B.cs == 1)
+                SIMD<double,NR>(B.p+k*B.rs+j0).storeAligned(Bp);
+              else
+                {
+                  for (size_t j = 0; j < nr; j++)
+                    Bp[j] = B(k, j0+j);
+                  for (size_t j = nr; j < NR; j++)
+                    Bp[j] = 0.0;
+                }
+              Bp += NR;
+            }
+        }
+    }
+
+
+    // C += Ap * Bp for an MR x NR tile of row-major C,
+    // only the upper-left mr x nr part is written back
+    template <size_t... I>
+    void microKernel (size_t kc, const double * Ap, const double * Bp,
+                      double * C, size_t ldc, size_t mr, size_t nr,
+                      std::index_sequence<I...>)
+    {
+      SIMD<double,NR> acc[MR];
+      ((acc[I] = SIMD<double,NR>(0.0)), ...);
+
+      for (size_t k = 0; k < kc; k++, Ap += MR, Bp += NR)
+        {
+          auto b = SIMD<double,NR>::loadAligned(Bp);
+          ((acc[I] = fma(SIMD<double,NR>(Ap[I]), b, acc[I])), ...);
+        }
+
+      if (mr == MR && nr == NR)
+        {
+          ((SIMD<double,NR>(C+I*ldc) + acc[I]).store(C+I*ldc), ...);
+          return;
+        }
+
+      alignas(64) double tile[MR*NR];
+      (acc[I].storeAligned(tile+I*NR), ...);
+      for (size_t i = 0; i < mr; i++)
+        for (size_t j = 0; j < nr; j++)
+          C[i*ldc+j] += tile[i*NR+j];
+    }
+
+
+    // C += alpha * A * B, C row-major
+    void gemmRowMajor (size_t M, size_t N, size_t K, double alpha,
+                       StridedMatrix A, StridedMatrix B, double * C, size_t ldc)
+    {
+      static thread_local AlignedVector<double> bufA, bufB;
+      bufA.resize(MC*KC);
+      bufB.resize(KC*NC);
+
+      for (size_t jc = 0; jc < N; jc += NC)
+        {
+          size_t nc = std::min(NC, N-jc);
+          for (size_t pc = 0; pc < K; pc += KC)
+            {
+              size_t kc = std::min(KC, K-pc);
+              packB (kc, nc, B.block(pc, jc), bufB.data());
+
+              for (size_t ic = 0; ic < M; ic += MC)
+                {
+                  size_t mc = std::min(MC, M-ic);
+                  packA (mc, kc, A.block(ic, pc), alpha, bufA.data());
+
+                  for (size_t jr = 0; jr < nc; jr += NR)
+                    for (size_t ir = 0; ir < mc; ir += MR)
+                      microKernel (kc, bufA.data()+ir*kc, bufB.data()+jr*kc,
+                                   C+(ic+ir)*ldc+jc+jr, ldc,
+                                   std::min(MR, mc-ir), std::min(NR, nc-jr),
+                                   std::make_index_sequence<MR>());
+                }
+            }
+        }
+    }
+  }
+
+
+
+  void gemm (Layout layout, Op opA, Op opB,
+             size_t M, size_t N, size_t K,
+             double alpha, const double * A, size_t lda,
+             const double * B, size_t ldb,
+             double beta, double * C, size_t ldc)
+  {
+    // strides of op(A), op(B) as stored row-major
+    StridedMatrix mA { A, lda, 1 };
+    StridedMatrix mB { B, ldb, 1 };
+    if (opA == Op::Trans) mA = mA.trans();
+    if (opB == Op::Trans) mB = mB.trans();
+
+    // column-major storage is the row-major transpose, and C^T = B^T A^T
+    if (layout == Layout::ColMajor)
+      {
+        std::tie(mA, mB) = std::make_pair(mB, mA);
+        std::swap (M, N);
+      }
+
+    for (size_t i = 0; i < M; i++)
+      for (size_t j = 0; j < N; j++)
+        C[i*ldc+j] = (beta == 0.0) ? 0.0 : beta*C[i*ldc+j];
+
+    if (M == 0 || N == 0 || K == 0 || alpha == 0.0) return;
+    gemmRowMajor (M, N, K, alpha, mA, mB, C, ldc);
+  }
+
+}
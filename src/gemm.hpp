@@ -0,0 +1,39 @@
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+#include <cstddef>
+
+
+namespace ASC_HPC
+{
+
+  enum class Layout { RowMajor, ColMajor };
+  enum class Op { NoTrans, Trans };
+
+  /*
+    C = alpha * op(A) * op(B) + beta * C
+
+    op(A) is M x K, op(B) is K x N, C is M x N.
+    lda, ldb, ldc are the distances between rows (RowMajor)
+    or columns (ColMajor) of the stored matrices.
+    beta = 0 overwrites C, i.e. C may be uninitialized.
+  */
+  void gemm (Layout layout, Op opA, Op opB,
+             size_t M, size_t N, size_t K,
+             double alpha, const double * A, size_t lda,
+             const double * B, size_t ldb,
+             double beta, double * C, size_t ldc);
+
+  // C = A * B, all row-major
+  inline void gemm (size_t M, size_t N, size_t K,
+                    const double * A, size_t lda,
+                    const double * B, size_t ldb,
+                    double * C, size_t ldc)
+  {
+    gemm (Layout::RowMajor, Op::NoTrans, Op::NoTrans, M, N, K,
+          1.0, A, lda, B, ldb, 0.0, C, ldc);
+  }
+
+}
+
+#endif
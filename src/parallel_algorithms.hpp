@@ -0,0 +1,124 @@
+#ifndef PARALLEL_ALGORITHMS_HPP
+#define PARALLEL_ALGORITHMS_HPP
+
+#include "taskmanager.hpp"
+#include "aligned_vector.hpp"
+
+
+/*
+  reductions and scans on top of RunParallel.
+
+  The range is cut into chunks, the number of chunks depends only on
+  the size, the grainsize and the number of threads, but not on the
+  scheduling. Partial results are combined in chunk order, so results
+  are reproducible from run to run. With an explicit grainsize they
+  don't depend on the number of threads either.
+
+  Accumulators may be SIMD<double,S> (or any copyable type), e.g. map
+  can return the vectorized partial sums of its sub-range.
+*/
+
+
+namespace ASC_HPC
+{
+
+  namespace detail
+  {
+    inline size_t numChunks (size_t n, size_t grainsize)
+    {
+      if (grainsize == 0)
+        return std::min (n, size_t(4*NumThreads()));
+      return (n+grainsize-1) / grainsize;
+    }
+  }
+
+
+  /*
+    combine(...combine(combine(identity, map(r0)), map(r1)) ..., map(rk))
+    for consecutive sub-ranges r0, ..., rk of r,
+    map(T_Range<T> sub) returns the partial result of a sub-range
+  */
+  template <typename T, typename TV, typename FMAP, typename FCOMBINE>
+  TV ParallelReduce (T_Range<T> r, TV identity,
+                     const FMAP & map, const FCOMBINE & combine,
+                     size_t grainsize = 0)
+  {
+    size_t num = detail::numChunks (r.size(), grainsize);
+    AlignedVector<CacheLinePadded<TV>> partial(num, { identity });
+
+    RunParallel (num, [&] (int i, int size)
+    {
+      partial[i].value = map (r.split(i, size));
+    });
+
+    TV sum = identity;
+    for (auto & p : partial)
+      sum = combine (sum, p.value);
+    return sum;
+  }
+
+  template <typename TV, typename FMAP, typename FCOMBINE>
+  TV ParallelReduce (size_t n, TV identity,
+                     const FMAP & map, const FCOMBINE & combine,
+                     size_t grainsize = 0)
+  {
+    return ParallelReduce (T_Range<size_t>(n), identity, map, combine, grainsize);
+  }
+
+
+  /*
+    inclusive scan out[i] = in[0] op in[1] op ... op in[i],
+    op must be associative, in and out may be the same array.
+
+    Two passes: reduce every chunk, scan the chunk results serially,
+    then scan every chunk starting from the result of its predecessors.
+  */
+  template <typename TV, typename FOP>
+  void ParallelScan (size_t n, const TV * in, TV * out, const FOP & op,
+                     size_t grainsize = 0)
+  {
+    size_t num = detail::numChunks (n, grainsize);
+    if (num == 0) return;
+    T_Range<size_t> r(n);
+    AlignedVector<CacheLinePadded<TV>> partial(num, { in[0] });
+
+    // the last chunk's total is not needed
+    RunParallel (num-1, [&] (int i, int size)
+    {
+      T_Range<size_t> sub = r.split(i, num);
+      TV sum = in[sub.first()];
+      for (size_t j = sub.first()+1; j < sub.next(); j++)
+        sum = op (sum, in[j]);
+      partial[i].value = sum;
+    });
+
+    // partial[i] becomes the total of chunks 0, ..., i-1
+    TV run = partial[0].value;
+    for (size_t i = 1; i < num; i++)
+      {
+        TV total = partial[i].value;
+        partial[i].value = run;
+        if (i+1 < num)
+          run = op (run, total);
+      }
+
+    RunParallel (num, [&] (int i, int size)
+    {
+      T_Range<size_t> sub = r.split(i, size);
+      TV sum = (i == 0) ? in[sub.first()] : op (partial[i].value, in[sub.first()]);
+      out[sub.first()] = sum;
+      for (size_t j = sub.first()+1; j < sub.next(); j++)
+        out[j] = sum = op (sum, in[j]);
+    });
+  }
+
+  // inclusive prefix sums
+  template <typename TV>
+  void ParallelPrefixSum (size_t n, const TV * in, TV * out, size_t grainsize = 0)
+  {
+    ParallelScan (n, in, out, [] (const TV & a, const TV & b) { return a+b; }, grainsize);
+  }
+
+}
+
+#endif
@@ -5,13 +5,19 @@
 #include<string>
 #include<memory>
 #include <array>
+#include <cstring>
+#include <tuple>
+#include <cmath>
+#include <algorithm>
 
 
 namespace ASC_HPC
 {
 
 
-#ifdef __AVX__
+#if defined(__AVX512F__)
+  constexpr size_t DefaultSimdSizeBytes = 64;
+#elif defined(__AVX__)
   constexpr size_t DefaultSimdSizeBytes = 32;
 #else
   constexpr size_t DefaultSimdSizeBytes = 16;
@@ -45,6 +51,32 @@ namespace ASC_HPC
     return ost;
   }
 
+  // mask for 32-bit lanes (float)
+  class mask32
+  {
+    int32_t m_mask;
+  public:
+    mask32 (bool b)
+      : m_mask{ b ? -1 : 0 } { }
+    auto val() const { return m_mask; }
+    operator bool() { return bool(m_mask); }
+  };
+
+  inline std::ostream & operator<< (std::ostream & ost, mask32 m)
+  {
+    ost << (m ? 't' : 'f');
+    return ost;
+  }
+
+  // the mask type matching the lane width of T
+  template <typename T> struct MaskType { typedef mask64 type; };
+  template <> struct MaskType<float> { typedef mask32 type; };
+  template <typename T> using mask_t = typename MaskType<T>::type;
+
+  template <typename T> constexpr bool is_mask = false;
+  template <> constexpr bool is_mask<mask64> = true;
+  template <> constexpr bool is_mask<mask32> = true;
+
   namespace detail {
     template <typename T, size_t N, size_t... I>
     auto array_range_impl(std::array<T, N> const& arr, size_t first,
@@ -56,6 +88,15 @@ namespace ASC_HPC
     auto array_range(std::array<T, N> const& arr) {
       return array_range_impl(arr, FIRST, std::make_index_sequence<NEXT-FIRST>{});
     }
+
+    // read lane i of a native register as type T, memcpy keeps it clean
+    // w.r.t. strict aliasing (integer registers are vectors of long long)
+    template <typename T, typename V>
+    T lane (const V & v, size_t i) {
+      T lanes[sizeof(V)/sizeof(T)];
+      std::memcpy (lanes, &v, sizeof(V));
+      return lanes[i];
+    }
   } // namespace detail
 
   
@@ -87,10 +128,10 @@ namespace ASC_HPC
     explicit SIMD (T val0, T2... vals)
       : SIMD(std::array<T, S>{val0, vals...}) { }
 
-    explicit SIMD (T * ptr)
+    explicit SIMD (const T * ptr)
       : m_lo(ptr), m_hi(ptr+S1) { }
     
-    explicit SIMD (T * ptr, SIMD<mask64,S> mask)
+    explicit SIMD (const T * ptr, SIMD<mask_t<T>,S> mask)
       : m_lo(ptr, mask.lo()), m_hi(ptr+S1, mask.hi()) { }
     
     
@@ -99,17 +140,32 @@ namespace ASC_HPC
     auto & hi() { return m_hi; }
 
     const T * ptr() const { return m_lo.ptr(); }
-    T operator[] (size_t i) const { return ptr()[i]; }
+    T operator[] (size_t i) const { return (i < S1) ? m_lo[i] : m_hi[i-S1]; }
 
     void store (T * ptr) const {
       m_lo.store(ptr);
       m_hi.store(ptr+S1);
     }
 
-    void store (T * ptr, SIMD<mask64,S> mask) const {
+    void store (T * ptr, SIMD<mask_t<T>,S> mask) const {
       m_lo.store(ptr, mask.lo());
       m_hi.store(ptr+S1, mask.hi());
     }
+
+    // ptr aligned to the natural alignment of the SIMD
+    static SIMD loadAligned (const T * ptr)
+    { return SIMD (SIMD<T,S1>::loadAligned(ptr), SIMD<T,S2>::loadAligned(ptr+S1)); }
+
+    void storeAligned (T * ptr) const {
+      m_lo.storeAligned(ptr);
+      m_hi.storeAligned(ptr+S1);
+    }
+
+    // non-temporal store, bypasses the cache (no read for ownership)
+    void storeStream (T * ptr) const {
+      m_lo.storeStream(ptr);
+      m_hi.storeStream(ptr+S1);
+    }
   };
 
 
@@ -122,11 +178,11 @@ namespace ASC_HPC
     SIMD() = default;
     SIMD(T val) : m_val(val) { }
     SIMD(std::array<T,1> vals) : m_val(vals[0]) { }
-    explicit SIMD (T * ptr) : m_val{*ptr} { } 
+    explicit SIMD (const T * ptr) : m_val{*ptr} { } 
 
     auto val() const { return m_val; }
     
-    explicit SIMD (T * ptr, SIMD<mask64,1> mask)
+    explicit SIMD (const T * ptr, SIMD<mask_t<T>,1> mask)
       : m_val{ mask.val() ? *ptr : T(0)} { }
 
     static constexpr size_t size() { return 1; }
@@ -134,7 +190,11 @@ namespace ASC_HPC
     T operator[] (size_t i) const { return m_val; }
 
     void store (T * ptr) const { *ptr = m_val; }
-    void store (T * ptr, SIMD<mask64,1> mask) const { if (mask.val()) *ptr = m_val; }
+    void store (T * ptr, SIMD<mask_t<T>,1> mask) const { if (mask.val()) *ptr = m_val; }
+
+    static SIMD loadAligned (const T * ptr) { return SIMD(*ptr); }
+    void storeAligned (T * ptr) const { *ptr = m_val; }
+    void storeStream (T * ptr) const { *ptr = m_val; }
   };
 
 
@@ -155,6 +215,17 @@ namespace ASC_HPC
   auto operator+ (SIMD<T,1> a, SIMD<T,1> b) { return SIMD<T,1> (a.val()+b.val()); }
 
 
+  template <typename T, size_t S>
+  auto operator- (SIMD<T,S> a, SIMD<T,S> b) { return SIMD<T,S> (a.lo()-b.lo(), a.hi()-b.hi()); }
+  template <typename T>
+  auto operator- (SIMD<T,1> a, SIMD<T,1> b) { return SIMD<T,1> (a.val()-b.val()); }
+
+  template <typename T, size_t S>
+  auto operator- (SIMD<T,S> a) { return SIMD<T,S> (-a.lo(), -a.hi()); }
+  template <typename T>
+  auto operator- (SIMD<T,1> a) { return SIMD<T,1> (-a.val()); }
+
+
   template <typename T, size_t S>
   auto operator* (SIMD<T,S> a, SIMD<T,S> b) { return SIMD<T,S> (a.lo()*b.lo(), a.hi()*b.hi()); }
   template <typename T>
@@ -165,8 +236,19 @@ namespace ASC_HPC
   template <typename T>
   auto operator* (double a, SIMD<T,1> b) { return SIMD<T,1> (a*b.val()); }
 
+  template <typename T, size_t S>
+  auto operator/ (SIMD<T,S> a, SIMD<T,S> b) { return SIMD<T,S> (a.lo()/b.lo(), a.hi()/b.hi()); }
+  template <typename T>
+  auto operator/ (SIMD<T,1> a, SIMD<T,1> b) { return SIMD<T,1> (a.val()/b.val()); }
+
   template <typename T, size_t S>
   auto operator+= (SIMD<T,S> & a, SIMD<T,S> b) { a = a+b; return a; }
+  template <typename T, size_t S>
+  auto operator-= (SIMD<T,S> & a, SIMD<T,S> b) { a = a-b; return a; }
+  template <typename T, size_t S>
+  auto operator*= (SIMD<T,S> & a, SIMD<T,S> b) { a = a*b; return a; }
+  template <typename T, size_t S>
+  auto operator/= (SIMD<T,S> & a, SIMD<T,S> b) { a = a/b; return a; }
   
   template <typename T, size_t S>
   auto fma(SIMD<T,S> a, SIMD<T,S> b, SIMD<T,S> c)
@@ -176,6 +258,51 @@ namespace ASC_HPC
   { return SIMD<T,1> (a.val()*b.val()+c.val()); }
 
 
+  template <typename T, size_t S>
+  auto min (SIMD<T,S> a, SIMD<T,S> b) { return SIMD<T,S> (min(a.lo(),b.lo()), min(a.hi(),b.hi())); }
+  template <typename T>
+  auto min (SIMD<T,1> a, SIMD<T,1> b) { return SIMD<T,1> (std::min(a.val(),b.val())); }
+
+  template <typename T, size_t S>
+  auto max (SIMD<T,S> a, SIMD<T,S> b) { return SIMD<T,S> (max(a.lo(),b.lo()), max(a.hi(),b.hi())); }
+  template <typename T>
+  auto max (SIMD<T,1> a, SIMD<T,1> b) { return SIMD<T,1> (std::max(a.val(),b.val())); }
+
+  template <typename T, size_t S>
+  auto abs (SIMD<T,S> a) { return SIMD<T,S> (abs(a.lo()), abs(a.hi())); }
+  template <typename T>
+  auto abs (SIMD<T,1> a) { return SIMD<T,1> (std::abs(a.val())); }
+
+  template <typename T, size_t S>
+  auto sqrt (SIMD<T,S> a) { return SIMD<T,S> (sqrt(a.lo()), sqrt(a.hi())); }
+  template <typename T>
+  auto sqrt (SIMD<T,1> a) { return SIMD<T,1> (std::sqrt(a.val())); }
+
+  // round to nearest integer, ties to even
+  template <typename T, size_t S>
+  auto nearbyint (SIMD<T,S> a) { return SIMD<T,S> (nearbyint(a.lo()), nearbyint(a.hi())); }
+  template <typename T>
+  auto nearbyint (SIMD<T,1> a) { return SIMD<T,1> (std::nearbyint(a.val())); }
+
+
+  // ****************** exponent bit manipulation ********************
+  // building blocks for the functions in simd_math.hpp
+
+  // 2^n for integral valued n in [-1022, 1023]
+  template <size_t S>
+  auto pow2i (SIMD<double,S> n) { return SIMD<double,S> (pow2i(n.lo()), pow2i(n.hi())); }
+  inline auto pow2i (SIMD<double,1> n) { return SIMD<double,1> (std::ldexp(1.0, int(n.val()))); }
+
+  // x = mantissa(x) * 2^exponent(x), mantissa in [1,2), for positive normal x
+  template <size_t S>
+  auto exponent (SIMD<double,S> x) { return SIMD<double,S> (exponent(x.lo()), exponent(x.hi())); }
+  inline auto exponent (SIMD<double,1> x) { return SIMD<double,1> (std::ilogb(x.val())); }
+
+  template <size_t S>
+  auto mantissa (SIMD<double,S> x) { return SIMD<double,S> (mantissa(x.lo()), mantissa(x.hi())); }
+  inline auto mantissa (SIMD<double,1> x) { return SIMD<double,1> (std::scalbn(x.val(), -std::ilogb(x.val()))); }
+
+
 
   // ****************** Horizontal sums *****************************
   
@@ -194,19 +321,131 @@ namespace ASC_HPC
   auto hSum(SIMD<T,1> a0, SIMD<T,1> a1)
   { return SIMD<T,2> (a0.val(), a1.val()); }
 
+  // lane i is hSum(ai)
+  template <typename T, size_t S>
+  auto hSum (SIMD<T,S> a0, SIMD<T,S> a1, SIMD<T,S> a2, SIMD<T,S> a3)
+  { return SIMD<T,4> (hSum(a0, a1), hSum(a2, a3)); }
+
 
   
   // ******************  select   ***********************************
 
   template <typename T>
-  auto select (SIMD<mask64,1> mask, SIMD<T,1> a, SIMD<T,1> b)
+  auto select (SIMD<mask_t<T>,1> mask, SIMD<T,1> a, SIMD<T,1> b)
   { return mask.val() ? a : b; }
   
   template <typename T, size_t S>
-  auto select (SIMD<mask64,S> mask, SIMD<T,S> a, SIMD<T,S> b)
+  auto select (SIMD<mask_t<T>,S> mask, SIMD<T,S> a, SIMD<T,S> b)
   { return SIMD<T,S> (select (mask.lo(), a.lo(), b.lo()),
                       select (mask.hi(), a.hi(), b.hi())); }
 
+  // ****************** prefetch ************************************
+  // LOCALITY 3 keeps the line in all cache levels, 0 is non-temporal
+
+  template <int LOCALITY = 3>
+  inline void prefetch (const void * p)
+  {
+#if defined(__GNUC__)
+    __builtin_prefetch (p, 0, LOCALITY);
+#endif
+  }
+
+  template <int LOCALITY = 3>
+  inline void prefetchWrite (const void * p)
+  {
+#if defined(__GNUC__)
+    __builtin_prefetch (p, 1, LOCALITY);
+#endif
+  }
+
+
+  // ****************** gather / scatter *****************************
+  // lane i reads/writes p[idx[i]], masked-out lanes are not accessed
+  // and gather to 0. scatter writes lanes in order, the highest lane
+  // wins for duplicate indices.
+
+  template <typename T, size_t S>
+  auto gather (const T * p, SIMD<int64_t,S> idx)
+  { return SIMD<T,S> (gather(p, idx.lo()), gather(p, idx.hi())); }
+  template <typename T>
+  auto gather (const T * p, SIMD<int64_t,1> idx)
+  { return SIMD<T,1> (p[idx.val()]); }
+
+  template <typename T, size_t S>
+  auto gather (const T * p, SIMD<int64_t,S> idx, SIMD<mask_t<T>,S> mask)
+  { return SIMD<T,S> (gather(p, idx.lo(), mask.lo()), gather(p, idx.hi(), mask.hi())); }
+  template <typename T>
+  auto gather (const T * p, SIMD<int64_t,1> idx, SIMD<mask_t<T>,1> mask)
+  { return SIMD<T,1> (mask.val() ? p[idx.val()] : T(0)); }
+
+  template <typename T, size_t S>
+  void scatter (T * p, SIMD<int64_t,S> idx, SIMD<T,S> val)
+  { scatter(p, idx.lo(), val.lo()); scatter(p, idx.hi(), val.hi()); }
+  template <typename T>
+  void scatter (T * p, SIMD<int64_t,1> idx, SIMD<T,1> val)
+  { p[idx.val()] = val.val(); }
+
+  template <typename T, size_t S>
+  void scatter (T * p, SIMD<int64_t,S> idx, SIMD<T,S> val, SIMD<mask_t<T>,S> mask)
+  { scatter(p, idx.lo(), val.lo(), mask.lo()); scatter(p, idx.hi(), val.hi(), mask.hi()); }
+  template <typename T>
+  void scatter (T * p, SIMD<int64_t,1> idx, SIMD<T,1> val, SIMD<mask_t<T>,1> mask)
+  { if (mask.val()) p[idx.val()] = val.val(); }
+
+  
+  // ****************** lane rearrangement **************************
+  // compile-time lane indices, backends overload the native widths
+
+  // result lane k is a[I_k]
+  template <int... I, typename T, size_t S>
+  auto permute (SIMD<T,S> a)
+  { return SIMD<T,sizeof...(I)> (std::array<T,sizeof...(I)>{ a[I]... }); }
+
+  // lane i is b[i] if bit i of MASK is set, a[i] otherwise
+  template <int MASK, typename T, size_t S>
+  auto blend (SIMD<T,S> a, SIMD<T,S> b)
+  {
+    constexpr size_t S1 = largestPowerOfTwo(S-1);
+    return SIMD<T,S> (blend<MASK & ((1 << S1)-1)> (a.lo(), b.lo()),
+                      blend<(MASK >> S1)> (a.hi(), b.hi()));
+  }
+  template <int MASK, typename T>
+  auto blend (SIMD<T,1> a, SIMD<T,1> b) { return (MASK & 1) ? b : a; }
+
+  namespace detail {
+    template <typename T, size_t S, size_t... I>
+    auto reverseImpl (SIMD<T,S> a, std::index_sequence<I...>) { return permute<int(S-1-I)...> (a); }
+
+    template <int K, typename T, size_t S, size_t... I>
+    auto rotateImpl (SIMD<T,S> a, std::index_sequence<I...>)
+    { return permute<((int(I)+K) % int(S) + int(S)) % int(S)...> (a); }
+  }
+
+  // all lanes are a[L]
+  template <int L, typename T, size_t S>
+  auto broadcast (SIMD<T,S> a) { return SIMD<T,S> (a[L]); }
+
+  // lane i is a[S-1-i]
+  template <typename T, size_t S>
+  auto reverse (SIMD<T,S> a) { return detail::reverseImpl (a, std::make_index_sequence<S>()); }
+
+  // lane i is a[(i+K) mod S], K may be negative
+  template <int K, typename T, size_t S>
+  auto rotate (SIMD<T,S> a) { return detail::rotateImpl<K> (a, std::make_index_sequence<S>()); }
+
+
+  // in-place transpose of the 4x4 matrix with rows a0..a3
+  template <typename T>
+  void transpose (SIMD<T,4> & a0, SIMD<T,4> & a1, SIMD<T,4> & a2, SIMD<T,4> & a3)
+  {
+    SIMD<T,4> b0(a0[0], a1[0], a2[0], a3[0]);
+    SIMD<T,4> b1(a0[1], a1[1], a2[1], a3[1]);
+    SIMD<T,4> b2(a0[2], a1[2], a2[2], a3[2]);
+    SIMD<T,4> b3(a0[3], a1[3], a2[3], a3[3]);
+    a0 = b0; a1 = b1; a2 = b2; a3 = b3;
+  }
+
+
   // ****************** IndexSequence ********************************
   
   template <typename T, size_t S, T first=0>
@@ -230,23 +469,84 @@ namespace ASC_HPC
 
   template <typename T, size_t S>
   auto operator>= (SIMD<T,S> a, SIMD<T,S> b)
-  { return SIMD<mask64,S>(a.lo()>=b.lo(), a.hi()>=b.hi()); }
+  { return SIMD<mask_t<T>,S>(a.lo()>=b.lo(), a.hi()>=b.hi()); }
 
   template <typename T>
   auto operator>= (SIMD<T,1> a, SIMD<T,1> b)
-  { return SIMD<mask64,1>(a.val()>=b.val()); }
+  { return SIMD<mask_t<T>,1>(a.val()>=b.val()); }
 
   template <typename TA, typename T, size_t S>
   auto operator>= (TA a, const SIMD<T,S> & b)
   { return SIMD<T,S>(a) >= b; }
+
+  template <typename T, size_t S>
+  auto operator> (SIMD<T,S> a, SIMD<T,S> b)
+  { return SIMD<mask_t<T>,S>(a.lo()>b.lo(), a.hi()>b.hi()); }
+  template <typename T>
+  auto operator> (SIMD<T,1> a, SIMD<T,1> b)
+  { return SIMD<mask_t<T>,1>(a.val()>b.val()); }
+
+  template <typename T, size_t S>
+  auto operator<= (SIMD<T,S> a, SIMD<T,S> b)
+  { return SIMD<mask_t<T>,S>(a.lo()<=b.lo(), a.hi()<=b.hi()); }
+  template <typename T>
+  auto operator<= (SIMD<T,1> a, SIMD<T,1> b)
+  { return SIMD<mask_t<T>,1>(a.val()<=b.val()); }
+
+  template <typename T, size_t S>
+  auto operator< (SIMD<T,S> a, SIMD<T,S> b)
+  { return SIMD<mask_t<T>,S>(a.lo()<b.lo(), a.hi()<b.hi()); }
+  template <typename T>
+  auto operator< (SIMD<T,1> a, SIMD<T,1> b)
+  { return SIMD<mask_t<T>,1>(a.val()<b.val()); }
+
+  template <typename T, size_t S>
+  auto operator== (SIMD<T,S> a, SIMD<T,S> b)
+  { return SIMD<mask_t<T>,S>(a.lo()==b.lo(), a.hi()==b.hi()); }
+  template <typename T>
+  auto operator== (SIMD<T,1> a, SIMD<T,1> b)
+  { return SIMD<mask_t<T>,1>(a.val()==b.val()); }
+
+  template <typename T, size_t S>
+  auto operator!= (SIMD<T,S> a, SIMD<T,S> b)
+  { return SIMD<mask_t<T>,S>(a.lo()!=b.lo(), a.hi()!=b.hi()); }
+  template <typename T>
+  auto operator!= (SIMD<T,1> a, SIMD<T,1> b)
+  { return SIMD<mask_t<T>,1>(a.val()!=b.val()); }
+
+
+  // ****************** mask logic ***********************************
+
+  template <typename M, size_t S, typename = std::enable_if_t<is_mask<M>>>
+  auto operator&& (SIMD<M,S> a, SIMD<M,S> b) { return SIMD<M,S> (a.lo()&&b.lo(), a.hi()&&b.hi()); }
+  template <typename M, typename = std::enable_if_t<is_mask<M>>>
+  auto operator&& (SIMD<M,1> a, SIMD<M,1> b) { return SIMD<M,1> (a.val()&&b.val()); }
+
+  template <typename M, size_t S, typename = std::enable_if_t<is_mask<M>>>
+  auto operator|| (SIMD<M,S> a, SIMD<M,S> b) { return SIMD<M,S> (a.lo()||b.lo(), a.hi()||b.hi()); }
+  template <typename M, typename = std::enable_if_t<is_mask<M>>>
+  auto operator|| (SIMD<M,1> a, SIMD<M,1> b) { return SIMD<M,1> (a.val()||b.val()); }
+
+  template <typename M, size_t S, typename = std::enable_if_t<is_mask<M>>>
+  auto operator! (SIMD<M,S> a) { return SIMD<M,S> (!a.lo(), !a.hi()); }
+  template <typename M, typename = std::enable_if_t<is_mask<M>>>
+  auto operator! (SIMD<M,1> a) { return SIMD<M,1> (!a.val()); }
   
 }
   
   
+#if defined(__SSE2__) || defined(_M_AMD64)
+#include "simd_sse.hpp"
+#endif
+
 #ifdef __AVX__
 #include "simd_avx.hpp"
 #endif
 
+#ifdef __AVX512F__
+#include "simd_avx512.hpp"
+#endif
+
 #if defined(__aarch64__) || defined(_M_ARM64)
 #include "simd_arm64.hpp"
 #endif
@@ -21,6 +21,7 @@ namespace ASC_HPC
     int64x2_t m_val;
   public:
     SIMD (int64x2_t val) : m_val(val) { };
+    SIMD (uint64x2_t val) : m_val(vreinterpretq_s64_u64(val)) { };
     SIMD (SIMD<mask64,1> v0, SIMD<mask64,1> v1)
       : m_val{vcombine_s64(int64x1_t{v0.val().val()}, int64x1_t{v1.val().val()})} { } 
 
@@ -68,6 +69,11 @@ namespace ASC_HPC
     {
       vst1q_f64(p, m_val);
     }
+
+    // NEON has no non-temporal store intrinsic, stream is a plain store
+    static SIMD loadAligned (double const * p) { return vld1q_f64(p); }
+    void storeAligned (double * p) const { vst1q_f64(p, m_val); }
+    void storeStream (double * p) const { vst1q_f64(p, m_val); }
     
     void store (double * p, SIMD<mask64,2> mask) const
     {
@@ -76,6 +82,75 @@ namespace ASC_HPC
     }
   };
 
+  template<>
+  class SIMD<mask32,4>
+  {
+    uint32x4_t m_val;
+  public:
+    SIMD (uint32x4_t val) : m_val(val) { };
+    SIMD (SIMD<mask32,2> v0, SIMD<mask32,2> v1)
+      : m_val{uint32_t(v0[0].val()), uint32_t(v0[1].val()), uint32_t(v1[0].val()), uint32_t(v1[1].val())} { }
+
+    auto val() const { return m_val; }
+    mask32 operator[](size_t i) const { return ( (int32_t*)&m_val)[i] != 0; }
+
+    SIMD<mask32, 2> lo() const { return SIMD<mask32,2>((*this)[0], (*this)[1]); }
+    SIMD<mask32, 2> hi() const { return SIMD<mask32,2>((*this)[2], (*this)[3]); }
+    const mask32 * ptr() const { return (mask32*)&m_val; }
+  };
+
+
+
+  template<>
+  class SIMD<float,4>
+  {
+    float32x4_t m_val;
+  public:
+    SIMD () = default;
+    SIMD (const SIMD &) = default;
+    SIMD (float val) : m_val{vdupq_n_f32(val)} { }
+    SIMD (float32x4_t val) : m_val(val) { }
+    SIMD (float v0, float v1, float v2, float v3) : m_val{v0, v1, v2, v3} { }
+    SIMD (SIMD<float,2> v0, SIMD<float,2> v1) : SIMD(v0[0], v0[1], v1[0], v1[1]) { }
+    SIMD (std::array<float, 4> arr) : m_val{arr[0], arr[1], arr[2], arr[3]} { }
+
+    SIMD (float const * p) : m_val{vld1q_f32(p)} { }
+    SIMD (float const * p, SIMD<mask32,4> mask)
+      {
+        for (int i = 0; i < 4; i++)
+          m_val[i] = mask[i] ? p[i] : 0;
+      }
+
+    static constexpr int size() { return 4; }
+    auto val() const { return m_val; }
+    const float * ptr() const { return (float*)&m_val; }
+
+    auto lo() const { return SIMD<float,2> (m_val[0], m_val[1]); }
+    auto hi() const { return SIMD<float,2> (m_val[2], m_val[3]); }
+    float operator[] (int i) const { return m_val[i]; }
+
+    void store (float * p) const
+    {
+      vst1q_f32(p, m_val);
+    }
+
+    static SIMD loadAligned (float const * p) { return vld1q_f32(p); }
+    void storeAligned (float * p) const { vst1q_f32(p, m_val); }
+    void storeStream (float * p) const { vst1q_f32(p, m_val); }
+
+    void store (float * p, SIMD<mask32,4> mask) const
+    {
+      for (int i = 0; i < 4; i++)
+        if (mask[i]) p[i] = m_val[i];
+    }
+  };
+
+
+
+  // storeStream is a plain store on NEON
+  inline void streamFence() { }
+
+
   inline auto operator+ (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<double,2> (a.val()+b.val()); }
   inline auto operator- (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<double,2> (a.val()-b.val()); }
   
@@ -86,6 +161,46 @@ namespace ASC_HPC
   inline SIMD<double,2> fma (SIMD<double,2> a, SIMD<double,2> b, SIMD<double,2> c) 
   { return vmlaq_f64(c.val(), a.val(), b.val()); }
 
+  inline auto operator/ (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<double,2> (vdivq_f64(a.val(), b.val())); }
+  inline auto operator- (SIMD<double,2> a) { return SIMD<double,2> (vnegq_f64(a.val())); }
+
+  inline SIMD<double,2> min (SIMD<double,2> a, SIMD<double,2> b) { return vminq_f64(a.val(), b.val()); }
+  inline SIMD<double,2> max (SIMD<double,2> a, SIMD<double,2> b) { return vmaxq_f64(a.val(), b.val()); }
+  inline SIMD<double,2> abs (SIMD<double,2> a) { return vabsq_f64(a.val()); }
+  inline SIMD<double,2> sqrt (SIMD<double,2> a) { return vsqrtq_f64(a.val()); }
+  inline SIMD<double,2> nearbyint (SIMD<double,2> a) { return vrndnq_f64(a.val()); }
+
+  // n+1023 lands in the low mantissa bits of 1.5*2^52+1023+n, shift it into the exponent
+  inline SIMD<double,2> pow2i (SIMD<double,2> n)
+  {
+    int64x2_t bits = vreinterpretq_s64_f64(vaddq_f64(n.val(), vdupq_n_f64(0x1.8p52+1023)));
+    return vreinterpretq_f64_s64(vshlq_n_s64(bits, 52));
+  }
+
+  inline SIMD<double,2> exponent (SIMD<double,2> x)
+  {
+    int64x2_t e = vreinterpretq_s64_u64(vshrq_n_u64(vreinterpretq_u64_f64(x.val()), 52));
+    return vcvtq_f64_s64(vsubq_s64(e, vdupq_n_s64(1023)));
+  }
+
+  inline SIMD<double,2> mantissa (SIMD<double,2> x)
+  {
+    uint64x2_t bits = vandq_u64(vreinterpretq_u64_f64(x.val()), vdupq_n_u64(0x000fffffffffffff));
+    return vreinterpretq_f64_u64(vorrq_u64(bits, vreinterpretq_u64_f64(vdupq_n_f64(1.0))));
+  }
+
+  inline auto operator>= (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<mask64,2>(vcgeq_f64(a.val(), b.val())); }
+  inline auto operator> (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<mask64,2>(vcgtq_f64(a.val(), b.val())); }
+  inline auto operator<= (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<mask64,2>(vcleq_f64(a.val(), b.val())); }
+  inline auto operator< (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<mask64,2>(vcltq_f64(a.val(), b.val())); }
+  inline auto operator== (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<mask64,2>(vceqq_f64(a.val(), b.val())); }
+  inline auto operator!= (SIMD<double,2> a, SIMD<double,2> b)
+  { return SIMD<mask64,2>(vreinterpretq_s64_u32(vmvnq_u32(vreinterpretq_u32_u64(vceqq_f64(a.val(), b.val()))))); }
+
+  inline SIMD<mask64,2> operator&& (SIMD<mask64,2> a, SIMD<mask64,2> b) { return vandq_s64(a.val(), b.val()); }
+  inline SIMD<mask64,2> operator|| (SIMD<mask64,2> a, SIMD<mask64,2> b) { return vorrq_s64(a.val(), b.val()); }
+  inline SIMD<mask64,2> operator! (SIMD<mask64,2> a)
+  { return vreinterpretq_s64_s32(vmvnq_s32(vreinterpretq_s32_s64(a.val()))); }
 
 
   inline SIMD<double,2> select (SIMD<mask64,2> mask, SIMD<double,2> b, SIMD<double,2> c)
@@ -93,6 +208,64 @@ namespace ASC_HPC
   
   inline SIMD<double,2> hSum (SIMD<double,2> a, SIMD<double,2> b)
   { return vpaddq_f64(a.val(), b.val()); }
+
+
+
+  inline auto operator+ (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<float,4> (a.val()+b.val()); }
+  inline auto operator- (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<float,4> (a.val()-b.val()); }
+
+  inline auto operator* (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<float,4> (a.val()*b.val()); }
+  inline auto operator* (float a, SIMD<float,4> b) { return SIMD<float,4> (a*b.val()); }
+
+  // a*b+c
+  inline SIMD<float,4> fma (SIMD<float,4> a, SIMD<float,4> b, SIMD<float,4> c)
+  { return vfmaq_f32(c.val(), a.val(), b.val()); }
+
+  inline auto operator/ (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<float,4> (vdivq_f32(a.val(), b.val())); }
+  inline auto operator- (SIMD<float,4> a) { return SIMD<float,4> (vnegq_f32(a.val())); }
+
+  inline SIMD<float,4> min (SIMD<float,4> a, SIMD<float,4> b) { return vminq_f32(a.val(), b.val()); }
+  inline SIMD<float,4> max (SIMD<float,4> a, SIMD<float,4> b) { return vmaxq_f32(a.val(), b.val()); }
+  inline SIMD<float,4> abs (SIMD<float,4> a) { return vabsq_f32(a.val()); }
+  inline SIMD<float,4> sqrt (SIMD<float,4> a) { return vsqrtq_f32(a.val()); }
+
+  inline auto operator>= (SIMD<float,4> a, SIMD<float,4> b)
+  { return SIMD<mask32,4>(vcgeq_f32(a.val(), b.val())); }
+  inline auto operator> (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<mask32,4>(vcgtq_f32(a.val(), b.val())); }
+  inline auto operator<= (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<mask32,4>(vcleq_f32(a.val(), b.val())); }
+  inline auto operator< (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<mask32,4>(vcltq_f32(a.val(), b.val())); }
+  inline auto operator== (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<mask32,4>(vceqq_f32(a.val(), b.val())); }
+  inline auto operator!= (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<mask32,4>(vmvnq_u32(vceqq_f32(a.val(), b.val()))); }
+
+  inline SIMD<mask32,4> operator&& (SIMD<mask32,4> a, SIMD<mask32,4> b) { return vandq_u32(a.val(), b.val()); }
+  inline SIMD<mask32,4> operator|| (SIMD<mask32,4> a, SIMD<mask32,4> b) { return vorrq_u32(a.val(), b.val()); }
+  inline SIMD<mask32,4> operator! (SIMD<mask32,4> a) { return vmvnq_u32(a.val()); }
+
+  inline SIMD<float,4> select (SIMD<mask32,4> mask, SIMD<float,4> b, SIMD<float,4> c)
+  { return vbslq_f32(mask.val(), b.val(), c.val()); }
+
+  inline float hSum (SIMD<float,4> a)
+  { return vaddvq_f32(a.val()); }
+
+  // pairwise adds: (a0+a1, a2+a3, b0+b1, b2+b3) -> (a, b, a, b)
+  inline SIMD<float,2> hSum (SIMD<float,4> a, SIMD<float,4> b)
+  {
+    float32x4_t sum = vpaddq_f32(a.val(), b.val());
+    sum = vpaddq_f32(sum, sum);
+    return SIMD<float,2> (sum[0], sum[1]);
+  }
+
+
+  // float <-> double conversion, one float vector fills two double vectors
+
+  inline SIMD<float,4> toFloat (SIMD<double,2> a, SIMD<double,2> b)
+  { return vcvt_high_f32_f64(vcvt_f32_f64(a.val()), b.val()); }
+
+  inline auto toDouble (SIMD<float,4> a)
+  {
+    return std::tuple(SIMD<double,2>(vcvt_f64_f32(vget_low_f32(a.val()))),
+                      SIMD<double,2>(vcvt_high_f64_f32(a.val())));
+  }
   
 }
 
@@ -21,11 +21,13 @@ namespace ASC_HPC
 
     SIMD (__m256i mask) : m_mask(mask) { };
     SIMD (__m256d mask) : m_mask(_mm256_castpd_si256(mask)) { ; }
+    SIMD (SIMD<mask64,2> v0, SIMD<mask64,2> v1) : m_mask(_mm256_set_m128i(v1.val(), v0.val())) { }
     auto val() const { return m_mask; }
-    mask64 operator[](size_t i) const { return ( (int64_t*)&m_mask)[i] != 0; }
+    mask64 operator[](size_t i) const { return detail::lane<int64_t>(m_mask, i) != 0; }
     
-    SIMD<mask64, 2> lo() const { return SIMD<mask64,2>((*this)[0], (*this)[1]); }
-    SIMD<mask64, 2> hi() const { return SIMD<mask64,2>((*this)[2], (*this)[3]); }
+    SIMD<mask64, 2> lo() const { return _mm256_extractf128_si256(m_mask, 0); }
+    SIMD<mask64, 2> hi() const { return _mm256_extractf128_si256(m_mask, 1); }
+    const mask64 * ptr() const { return (mask64*)&m_mask; }
   };
 
 
@@ -40,7 +42,7 @@ namespace ASC_HPC
     SIMD(double val) : m_val{_mm256_set1_pd(val)} {};
     SIMD(__m256d val) : m_val{val} {};
     SIMD (double v0, double v1, double v2, double v3) : m_val{_mm256_set_pd(v3,v2,v1,v0)} {  }
-    SIMD (SIMD<double,2> v0, SIMD<double,2> v1) : SIMD(v0[0], v0[1], v1[0], v1[1]) { }  // better with _mm256_set_m128d
+    SIMD (SIMD<double,2> v0, SIMD<double,2> v1) : m_val{_mm256_set_m128d(v1.val(), v0.val())} { }
     SIMD (std::array<double,4> a) : SIMD(a[0],a[1],a[2],a[3]) { }
     SIMD (double const * p) { m_val = _mm256_loadu_pd(p); }
     SIMD (double const * p, SIMD<mask64,4> mask) { m_val = _mm256_maskload_pd(p, mask.val()); }
@@ -48,15 +50,15 @@ namespace ASC_HPC
     static constexpr int size() { return 4; }
     auto val() const { return m_val; }
     const double * ptr() const { return (double*)&m_val; }
-    SIMD<double, 2> lo() const { return SIMD<double,2>((*this)[0], (*this)[1]); }
-    SIMD<double, 2> hi() const { return SIMD<double,2>((*this)[2], (*this)[3]); }
-
-    // better:
-    // SIMD<double, 2> lo() const { return _mm256_extractf128_pd(m_val, 0); }
-    // SIMD<double, 2> hi() const { return _mm256_extractf128_pd(m_val, 1); }
+    SIMD<double, 2> lo() const { return _mm256_extractf128_pd(m_val, 0); }
+    SIMD<double, 2> hi() const { return _mm256_extractf128_pd(m_val, 1); }
     double operator[](size_t i) const { return ((double*)&m_val)[i]; }
 
     void store (double * p) const { _mm256_storeu_pd(p, m_val); }
+
+    static SIMD loadAligned (double const * p) { return _mm256_load_pd(p); }
+    void storeAligned (double * p) const { _mm256_store_pd(p, m_val); }
+    void storeStream (double * p) const { _mm256_stream_pd(p, m_val); }
     void store (double * p, SIMD<mask64,4> mask) const { _mm256_maskstore_pd(p, mask.val(), m_val); }
   };
   
@@ -73,21 +75,83 @@ namespace ASC_HPC
     SIMD(int64_t val) : m_val{_mm256_set1_epi64x(val)} {};
     SIMD(__m256i val) : m_val{val} {};
     SIMD (int64_t v0, int64_t v1, int64_t v2, int64_t v3) : m_val{_mm256_set_epi64x(v3,v2,v1,v0) } { } 
-    SIMD (SIMD<int64_t,2> v0, SIMD<int64_t,2> v1) : SIMD(v0[0], v0[1], v1[0], v1[1]) { }  // can do better !
-    // SIMD (std::array<double,4> a) : SIMD(a[0],a[1],a[2],a[3]) { }
-    // SIMD (double const * p) { val = _mm256_loadu_pd(p); }
-    // SIMD (double const * p, SIMD<mask64,4> mask) { val = _mm256_maskload_pd(p, mask.val()); }
+    SIMD (SIMD<int64_t,2> v0, SIMD<int64_t,2> v1) : m_val{_mm256_set_m128i(v1.val(), v0.val())} { }
+    SIMD (std::array<int64_t,4> a) : SIMD(a[0],a[1],a[2],a[3]) { }
+    SIMD (int64_t const * p) { m_val = _mm256_loadu_si256((__m256i const*)p); }
+    // the pd versions move 64-bit lanes bitwise and need only AVX
+    SIMD (int64_t const * p, SIMD<mask64,4> mask)
+      : m_val{_mm256_castpd_si256(_mm256_maskload_pd((double const*)p, mask.val()))} { }
     
     static constexpr int size() { return 4; }
     auto val() const { return m_val; }
-    // const double * Ptr() const { return (double*)&val; }
-    // SIMD<double, 2> Lo() const { return _mm256_extractf128_pd(val, 0); }
-    // SIMD<double, 2> Hi() const { return _mm256_extractf128_pd(val, 1); }
-    int64_t operator[](size_t i) const { return ((int64_t*)&m_val)[i]; }
+    const int64_t * ptr() const { return (int64_t*)&m_val; }
+    SIMD<int64_t, 2> lo() const { return _mm256_extractf128_si256(m_val, 0); }
+    SIMD<int64_t, 2> hi() const { return _mm256_extractf128_si256(m_val, 1); }
+    int64_t operator[](size_t i) const { return detail::lane<int64_t>(m_val, i); }
+
+    void store (int64_t * p) const { _mm256_storeu_si256((__m256i*)p, m_val); }
+    void store (int64_t * p, SIMD<mask64,4> mask) const
+    { _mm256_maskstore_pd((double*)p, mask.val(), _mm256_castsi256_pd(m_val)); }
+
+    static SIMD loadAligned (int64_t const * p) { return _mm256_load_si256((__m256i const*)p); }
+    void storeAligned (int64_t * p) const { _mm256_store_si256((__m256i*)p, m_val); }
+    void storeStream (int64_t * p) const { _mm256_stream_si256((__m256i*)p, m_val); }
   };
   
 
 
+  template<>
+  class SIMD<mask32,8>
+  {
+    __m256i m_mask;
+  public:
+
+    SIMD (__m256i mask) : m_mask(mask) { };
+    SIMD (__m256 mask) : m_mask(_mm256_castps_si256(mask)) { ; }
+    SIMD (SIMD<mask32,4> v0, SIMD<mask32,4> v1) : m_mask(_mm256_set_m128i(v1.val(), v0.val())) { }
+    auto val() const { return m_mask; }
+    mask32 operator[](size_t i) const { return detail::lane<int32_t>(m_mask, i) != 0; }
+
+    SIMD<mask32, 4> lo() const { return _mm256_extractf128_si256(m_mask, 0); }
+    SIMD<mask32, 4> hi() const { return _mm256_extractf128_si256(m_mask, 1); }
+    const mask32 * ptr() const { return (mask32*)&m_mask; }
+  };
+
+
+
+  template<>
+  class SIMD<float,8>
+  {
+    __m256 m_val;
+  public:
+    SIMD () = default;
+    SIMD (const SIMD &) = default;
+    SIMD(float val) : m_val{_mm256_set1_ps(val)} {};
+    SIMD(__m256 val) : m_val{val} {};
+    SIMD (float v0, float v1, float v2, float v3, float v4, float v5, float v6, float v7)
+      : m_val{_mm256_set_ps(v7,v6,v5,v4,v3,v2,v1,v0)} {  }
+    SIMD (SIMD<float,4> v0, SIMD<float,4> v1) : m_val{_mm256_set_m128(v1.val(), v0.val())} { }
+    SIMD (std::array<float,8> a) : SIMD(a[0],a[1],a[2],a[3],a[4],a[5],a[6],a[7]) { }
+    SIMD (float const * p) { m_val = _mm256_loadu_ps(p); }
+    SIMD (float const * p, SIMD<mask32,8> mask) { m_val = _mm256_maskload_ps(p, mask.val()); }
+
+    static constexpr int size() { return 8; }
+    auto val() const { return m_val; }
+    const float * ptr() const { return (float*)&m_val; }
+    SIMD<float, 4> lo() const { return _mm256_extractf128_ps(m_val, 0); }
+    SIMD<float, 4> hi() const { return _mm256_extractf128_ps(m_val, 1); }
+    float operator[](size_t i) const { return ((float*)&m_val)[i]; }
+
+    void store (float * p) const { _mm256_storeu_ps(p, m_val); }
+
+    static SIMD loadAligned (float const * p) { return _mm256_load_ps(p); }
+    void storeAligned (float * p) const { _mm256_store_ps(p, m_val); }
+    void storeStream (float * p) const { _mm256_stream_ps(p, m_val); }
+    void store (float * p, SIMD<mask32,8> mask) const { _mm256_maskstore_ps(p, mask.val(), m_val); }
+  };
+
+
+
   template <int64_t first>
   class IndexSequence<int64_t, 4, first> : public SIMD<int64_t,4>
   {
@@ -104,18 +168,220 @@ namespace ASC_HPC
   
   inline auto operator* (SIMD<double,4> a, SIMD<double,4> b) { return SIMD<double,4> (_mm256_mul_pd(a.val(), b.val())); }
   inline auto operator* (double a, SIMD<double,4> b) { return SIMD<double,4>(a)*b; }
+
+#ifdef __AVX2__
+  inline auto operator+ (SIMD<int64_t,4> a, SIMD<int64_t,4> b) { return SIMD<int64_t,4> (_mm256_add_epi64(a.val(), b.val())); }
+  inline auto operator- (SIMD<int64_t,4> a, SIMD<int64_t,4> b) { return SIMD<int64_t,4> (_mm256_sub_epi64(a.val(), b.val())); }
+#endif
+  
+  inline auto operator+ (SIMD<float,8> a, SIMD<float,8> b) { return SIMD<float,8> (_mm256_add_ps(a.val(), b.val())); }
+  inline auto operator- (SIMD<float,8> a, SIMD<float,8> b) { return SIMD<float,8> (_mm256_sub_ps(a.val(), b.val())); }
+
+  inline auto operator* (SIMD<float,8> a, SIMD<float,8> b) { return SIMD<float,8> (_mm256_mul_ps(a.val(), b.val())); }
+  inline auto operator* (float a, SIMD<float,8> b) { return SIMD<float,8>(a)*b; }
+
+  inline auto operator/ (SIMD<double,4> a, SIMD<double,4> b) { return SIMD<double,4> (_mm256_div_pd(a.val(), b.val())); }
+  inline auto operator/ (SIMD<float,8> a, SIMD<float,8> b) { return SIMD<float,8> (_mm256_div_ps(a.val(), b.val())); }
+
+  // flip the sign bit
+  inline auto operator- (SIMD<double,4> a) { return SIMD<double,4> (_mm256_xor_pd(a.val(), _mm256_set1_pd(-0.0))); }
+  inline auto operator- (SIMD<float,8> a) { return SIMD<float,8> (_mm256_xor_ps(a.val(), _mm256_set1_ps(-0.0f))); }
   
 #ifdef __FMA__
   inline SIMD<double,4> fma (SIMD<double,4> a, SIMD<double,4> b, SIMD<double,4> c)
   { return _mm256_fmadd_pd (a.val(), b.val(), c.val()); }
+  inline SIMD<float,8> fma (SIMD<float,8> a, SIMD<float,8> b, SIMD<float,8> c)
+  { return _mm256_fmadd_ps (a.val(), b.val(), c.val()); }
 #endif
 
+  inline SIMD<double,4> min (SIMD<double,4> a, SIMD<double,4> b) { return _mm256_min_pd(a.val(), b.val()); }
+  inline SIMD<double,4> max (SIMD<double,4> a, SIMD<double,4> b) { return _mm256_max_pd(a.val(), b.val()); }
+  inline SIMD<double,4> abs (SIMD<double,4> a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.val()); }
+  inline SIMD<double,4> sqrt (SIMD<double,4> a) { return _mm256_sqrt_pd(a.val()); }
+
+  inline SIMD<double,4> nearbyint (SIMD<double,4> a)
+  { return _mm256_round_pd(a.val(), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+#ifdef __AVX2__
+  // same bit tricks as for SSE, see simd_sse.hpp
+  inline SIMD<double,4> pow2i (SIMD<double,4> n)
+  {
+    __m256i bits = _mm256_castpd_si256(_mm256_add_pd(n.val(), _mm256_set1_pd(0x1.8p52+1023)));
+    return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+  }
+
+  inline SIMD<double,4> exponent (SIMD<double,4> x)
+  {
+    __m256i bits = _mm256_or_si256(_mm256_srli_epi64(_mm256_castpd_si256(x.val()), 52),
+                                   _mm256_castpd_si256(_mm256_set1_pd(0x1p52)));
+    return _mm256_sub_pd(_mm256_castsi256_pd(bits), _mm256_set1_pd(0x1p52+1023));
+  }
+#endif
+
+  inline SIMD<double,4> mantissa (SIMD<double,4> x)
+  {
+    __m256d mant = _mm256_castsi256_pd(_mm256_set1_epi64x(0x000fffffffffffff));
+    return _mm256_or_pd(_mm256_and_pd(x.val(), mant), _mm256_set1_pd(1.0));
+  }
+
+  inline SIMD<float,8> min (SIMD<float,8> a, SIMD<float,8> b) { return _mm256_min_ps(a.val(), b.val()); }
+  inline SIMD<float,8> max (SIMD<float,8> a, SIMD<float,8> b) { return _mm256_max_ps(a.val(), b.val()); }
+  inline SIMD<float,8> abs (SIMD<float,8> a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.val()); }
+  inline SIMD<float,8> sqrt (SIMD<float,8> a) { return _mm256_sqrt_ps(a.val()); }
+
+#ifdef __AVX2__
   inline SIMD<mask64,4> operator>= (SIMD<int64_t,4> a , SIMD<int64_t,4> b)
   { // there is no a>=b, so we return !(b>a)
     return  _mm256_xor_si256(_mm256_cmpgt_epi64(b.val(),a.val()),_mm256_set1_epi32(-1)); }
+  inline SIMD<mask64,4> operator> (SIMD<int64_t,4> a , SIMD<int64_t,4> b)
+  { return _mm256_cmpgt_epi64(a.val(), b.val()); }
+  inline SIMD<mask64,4> operator<= (SIMD<int64_t,4> a , SIMD<int64_t,4> b)
+  { return _mm256_xor_si256(_mm256_cmpgt_epi64(a.val(),b.val()),_mm256_set1_epi32(-1)); }
+  inline SIMD<mask64,4> operator< (SIMD<int64_t,4> a , SIMD<int64_t,4> b)
+  { return _mm256_cmpgt_epi64(b.val(), a.val()); }
+  inline SIMD<mask64,4> operator== (SIMD<int64_t,4> a , SIMD<int64_t,4> b)
+  { return _mm256_cmpeq_epi64(a.val(), b.val()); }
+  inline SIMD<mask64,4> operator!= (SIMD<int64_t,4> a , SIMD<int64_t,4> b)
+  { return _mm256_xor_si256(_mm256_cmpeq_epi64(a.val(),b.val()),_mm256_set1_epi32(-1)); }
+#endif
   
   inline auto operator>= (SIMD<double,4> a, SIMD<double,4> b)
   { return SIMD<mask64,4>(_mm256_cmp_pd (a.val(), b.val(), _CMP_GE_OQ)); }
+  inline auto operator> (SIMD<double,4> a, SIMD<double,4> b)
+  { return SIMD<mask64,4>(_mm256_cmp_pd (a.val(), b.val(), _CMP_GT_OQ)); }
+  inline auto operator<= (SIMD<double,4> a, SIMD<double,4> b)
+  { return SIMD<mask64,4>(_mm256_cmp_pd (a.val(), b.val(), _CMP_LE_OQ)); }
+  inline auto operator< (SIMD<double,4> a, SIMD<double,4> b)
+  { return SIMD<mask64,4>(_mm256_cmp_pd (a.val(), b.val(), _CMP_LT_OQ)); }
+  inline auto operator== (SIMD<double,4> a, SIMD<double,4> b)
+  { return SIMD<mask64,4>(_mm256_cmp_pd (a.val(), b.val(), _CMP_EQ_OQ)); }
+  inline auto operator!= (SIMD<double,4> a, SIMD<double,4> b)
+  { return SIMD<mask64,4>(_mm256_cmp_pd (a.val(), b.val(), _CMP_NEQ_UQ)); }
+
+  inline auto operator>= (SIMD<float,8> a, SIMD<float,8> b)
+  { return SIMD<mask32,8>(_mm256_cmp_ps (a.val(), b.val(), _CMP_GE_OQ)); }
+  inline auto operator> (SIMD<float,8> a, SIMD<float,8> b)
+  { return SIMD<mask32,8>(_mm256_cmp_ps (a.val(), b.val(), _CMP_GT_OQ)); }
+  inline auto operator<= (SIMD<float,8> a, SIMD<float,8> b)
+  { return SIMD<mask32,8>(_mm256_cmp_ps (a.val(), b.val(), _CMP_LE_OQ)); }
+  inline auto operator< (SIMD<float,8> a, SIMD<float,8> b)
+  { return SIMD<mask32,8>(_mm256_cmp_ps (a.val(), b.val(), _CMP_LT_OQ)); }
+  inline auto operator== (SIMD<float,8> a, SIMD<float,8> b)
+  { return SIMD<mask32,8>(_mm256_cmp_ps (a.val(), b.val(), _CMP_EQ_OQ)); }
+  inline auto operator!= (SIMD<float,8> a, SIMD<float,8> b)
+  { return SIMD<mask32,8>(_mm256_cmp_ps (a.val(), b.val(), _CMP_NEQ_UQ)); }
+
+
+  // plain AVX has no 256-bit integer logic, go through the pd/ps variants
+  inline SIMD<mask64,4> operator&& (SIMD<mask64,4> a, SIMD<mask64,4> b)
+  { return _mm256_and_pd(_mm256_castsi256_pd(a.val()), _mm256_castsi256_pd(b.val())); }
+  inline SIMD<mask64,4> operator|| (SIMD<mask64,4> a, SIMD<mask64,4> b)
+  { return _mm256_or_pd(_mm256_castsi256_pd(a.val()), _mm256_castsi256_pd(b.val())); }
+  inline SIMD<mask64,4> operator! (SIMD<mask64,4> a)
+  { return _mm256_xor_pd(_mm256_castsi256_pd(a.val()), _mm256_castsi256_pd(_mm256_set1_epi32(-1))); }
+
+  inline SIMD<mask32,8> operator&& (SIMD<mask32,8> a, SIMD<mask32,8> b)
+  { return _mm256_and_ps(_mm256_castsi256_ps(a.val()), _mm256_castsi256_ps(b.val())); }
+  inline SIMD<mask32,8> operator|| (SIMD<mask32,8> a, SIMD<mask32,8> b)
+  { return _mm256_or_ps(_mm256_castsi256_ps(a.val()), _mm256_castsi256_ps(b.val())); }
+  inline SIMD<mask32,8> operator! (SIMD<mask32,8> a)
+  { return _mm256_xor_ps(_mm256_castsi256_ps(a.val()), _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+
+
+  inline SIMD<double,4> select (SIMD<mask64,4> mask, SIMD<double,4> b, SIMD<double,4> c)
+  { return _mm256_blendv_pd(c.val(), b.val(), _mm256_castsi256_pd(mask.val())); }
+  inline SIMD<float,8> select (SIMD<mask32,8> mask, SIMD<float,8> b, SIMD<float,8> c)
+  { return _mm256_blendv_ps(c.val(), b.val(), _mm256_castsi256_ps(mask.val())); }
+
+
+#ifdef __AVX2__
+  // no scatter instruction before AVX-512, scatter uses the generic lane-wise version
+  inline SIMD<double,4> gather (const double * p, SIMD<int64_t,4> idx)
+  { return _mm256_i64gather_pd(p, idx.val(), 8); }
+  inline SIMD<double,4> gather (const double * p, SIMD<int64_t,4> idx, SIMD<mask64,4> mask)
+  { return _mm256_mask_i64gather_pd(_mm256_setzero_pd(), p, idx.val(), _mm256_castsi256_pd(mask.val()), 8); }
+
+  inline SIMD<int64_t,4> gather (const int64_t * p, SIMD<int64_t,4> idx)
+  { return _mm256_i64gather_epi64((const long long*)p, idx.val(), 8); }
+  inline SIMD<int64_t,4> gather (const int64_t * p, SIMD<int64_t,4> idx, SIMD<mask64,4> mask)
+  { return _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), (const long long*)p, idx.val(), mask.val(), 8); }
+
+  // four 64-bit indices fetch four floats
+  inline SIMD<float,4> gather (const float * p, SIMD<int64_t,4> idx)
+  { return _mm256_i64gather_ps(p, idx.val(), 4); }
+  inline SIMD<float,4> gather (const float * p, SIMD<int64_t,4> idx, SIMD<mask32,4> mask)
+  { return _mm256_mask_i64gather_ps(_mm_setzero_ps(), p, idx.val(), _mm_castsi128_ps(mask.val()), 4); }
+#endif
+
+
+  template <int I0, int I1, int I2, int I3>
+  SIMD<double,4> permute (SIMD<double,4> a)
+  {
+#ifdef __AVX2__
+    return _mm256_permute4x64_pd(a.val(), I0 | (I1 << 2) | (I2 << 4) | (I3 << 6));
+#else
+    // AVX permutes only within 128-bit halves: duplicate each half,
+    // pick within the halves, then blend lanes coming from the upper half
+    __m256d lolo = _mm256_permute2f128_pd(a.val(), a.val(), 0x00);
+    __m256d hihi = _mm256_permute2f128_pd(a.val(), a.val(), 0x11);
+    constexpr int inlane = (I0 & 1) | ((I1 & 1) << 1) | ((I2 & 1) << 2) | ((I3 & 1) << 3);
+    constexpr int fromhi = (I0 >> 1) | ((I1 >> 1) << 1) | ((I2 >> 1) << 2) | ((I3 >> 1) << 3);
+    return _mm256_blend_pd(_mm256_permute_pd(lolo, inlane), _mm256_permute_pd(hihi, inlane), fromhi);
+#endif
+  }
+
+  template <int MASK>
+  SIMD<double,4> blend (SIMD<double,4> a, SIMD<double,4> b)
+  { return _mm256_blend_pd(a.val(), b.val(), MASK & 15); }
+
+  template <int L>
+  SIMD<double,4> broadcast (SIMD<double,4> a) { return permute<L,L,L,L> (a); }
+
+  inline void transpose (SIMD<double,4> & a0, SIMD<double,4> & a1, SIMD<double,4> & a2, SIMD<double,4> & a3)
+  {
+    __m256d t0 = _mm256_unpacklo_pd(a0.val(), a1.val());   // a00 a10 a02 a12
+    __m256d t1 = _mm256_unpackhi_pd(a0.val(), a1.val());   // a01 a11 a03 a13
+    __m256d t2 = _mm256_unpacklo_pd(a2.val(), a3.val());
+    __m256d t3 = _mm256_unpackhi_pd(a2.val(), a3.val());
+    a0 = _mm256_permute2f128_pd(t0, t2, 0x20);
+    a1 = _mm256_permute2f128_pd(t1, t3, 0x20);
+    a2 = _mm256_permute2f128_pd(t0, t2, 0x31);
+    a3 = _mm256_permute2f128_pd(t1, t3, 0x31);
+  }
+
+
+  inline double hSum (SIMD<double,4> a)
+  { return hSum(a.lo()+a.hi()); }
+
+  // (a0+a1, b0+b1, a2+a3, b2+b3), then add the two 128-bit halves
+  inline SIMD<double,2> hSum (SIMD<double,4> a, SIMD<double,4> b)
+  {
+    SIMD<double,4> sum = _mm256_hadd_pd(a.val(), b.val());
+    return sum.lo()+sum.hi();
+  }
+
+  // pairwise sums of all four, then add the crossed 128-bit halves
+  inline SIMD<double,4> hSum (SIMD<double,4> a0, SIMD<double,4> a1, SIMD<double,4> a2, SIMD<double,4> a3)
+  {
+    __m256d h01 = _mm256_hadd_pd(a0.val(), a1.val());
+    __m256d h23 = _mm256_hadd_pd(a2.val(), a3.val());
+    return _mm256_add_pd(_mm256_permute2f128_pd(h01, h23, 0x20), _mm256_permute2f128_pd(h01, h23, 0x31));
+  }
+
+  inline float hSum (SIMD<float,8> a)
+  { return hSum(a.lo()+a.hi()); }
+
+  inline SIMD<float,2> hSum (SIMD<float,8> a, SIMD<float,8> b)
+  { return hSum(a.lo()+a.hi(), b.lo()+b.hi()); }
+
+
+  // float <-> double conversion, one float vector fills two double vectors
+
+  inline SIMD<float,8> toFloat (SIMD<double,4> a, SIMD<double,4> b)
+  { return SIMD<float,8>(SIMD<float,4>(_mm256_cvtpd_ps(a.val())), SIMD<float,4>(_mm256_cvtpd_ps(b.val()))); }
+
+  inline auto toDouble (SIMD<float,8> a)
+  { return std::tuple(SIMD<double,4>(_mm256_cvtps_pd(a.lo().val())), SIMD<double,4>(_mm256_cvtps_pd(a.hi().val()))); }
   
 
   
@@ -0,0 +1,235 @@
+#ifndef SIMD_AVX512_HPP
+#define SIMD_AVX512_HPP
+
+#include <immintrin.h>
+
+
+/*
+  implementation of 8-wide SIMDs for Intel-CPUs with AVX512F support:
+  https://www.intel.com/content/www/us/en/docs/intrinsics-guide/index.html
+
+  masks live in k-registers (__mmask8, one bit per lane)
+ */
+
+
+namespace ASC_HPC
+{
+
+  template<>
+  class SIMD<mask64,8>
+  {
+    __mmask8 m_mask;
+  public:
+
+    SIMD (__mmask8 mask) : m_mask(mask) { };
+    SIMD (SIMD<mask64,4> v0, SIMD<mask64,4> v1)
+      : m_mask{_mm512_test_epi64_mask(_mm512_inserti64x4(_mm512_castsi256_si512(v0.val()), v1.val(), 1),
+                                      _mm512_set1_epi64(-1))} { }
+    auto val() const { return m_mask; }
+    mask64 operator[](size_t i) const { return bool((m_mask >> i) & 1); }
+
+    // expand bits to full 64-bit lanes for the AVX halves
+    SIMD<mask64, 4> lo() const { return _mm512_castsi512_si256(_mm512_maskz_set1_epi64(m_mask, -1)); }
+    SIMD<mask64, 4> hi() const { return _mm512_extracti64x4_epi64(_mm512_maskz_set1_epi64(m_mask, -1), 1); }
+  };
+
+
+
+  template<>
+  class SIMD<double,8>
+  {
+    __m512d m_val;
+  public:
+    SIMD () = default;
+    SIMD (const SIMD &) = default;
+    SIMD(double val) : m_val{_mm512_set1_pd(val)} {};
+    SIMD(__m512d val) : m_val{val} {};
+    SIMD (double v0, double v1, double v2, double v3, double v4, double v5, double v6, double v7)
+      : m_val{_mm512_set_pd(v7,v6,v5,v4,v3,v2,v1,v0)} {  }
+    SIMD (SIMD<double,4> v0, SIMD<double,4> v1)
+      : m_val{_mm512_insertf64x4(_mm512_castpd256_pd512(v0.val()), v1.val(), 1)} { }
+    SIMD (std::array<double,8> a) : SIMD(a[0],a[1],a[2],a[3],a[4],a[5],a[6],a[7]) { }
+    SIMD (double const * p) { m_val = _mm512_loadu_pd(p); }
+    SIMD (double const * p, SIMD<mask64,8> mask) { m_val = _mm512_maskz_loadu_pd(mask.val(), p); }
+
+    static constexpr int size() { return 8; }
+    auto val() const { return m_val; }
+    const double * ptr() const { return (double*)&m_val; }
+    SIMD<double, 4> lo() const { return _mm512_castpd512_pd256(m_val); }
+    SIMD<double, 4> hi() const { return _mm512_extractf64x4_pd(m_val, 1); }
+    double operator[](size_t i) const { return ((double*)&m_val)[i]; }
+
+    void store (double * p) const { _mm512_storeu_pd(p, m_val); }
+
+    static SIMD loadAligned (double const * p) { return _mm512_load_pd(p); }
+    void storeAligned (double * p) const { _mm512_store_pd(p, m_val); }
+    void storeStream (double * p) const { _mm512_stream_pd(p, m_val); }
+    void store (double * p, SIMD<mask64,8> mask) const { _mm512_mask_storeu_pd(p, mask.val(), m_val); }
+  };
+
+
+
+  template<>
+  class SIMD<int64_t,8>
+  {
+    __m512i m_val;
+  public:
+    SIMD () = default;
+    SIMD (const SIMD &) = default;
+    SIMD(int64_t val) : m_val{_mm512_set1_epi64(val)} {};
+    SIMD(__m512i val) : m_val{val} {};
+    SIMD (int64_t v0, int64_t v1, int64_t v2, int64_t v3, int64_t v4, int64_t v5, int64_t v6, int64_t v7)
+      : m_val{_mm512_set_epi64(v7,v6,v5,v4,v3,v2,v1,v0)} { }
+    SIMD (SIMD<int64_t,4> v0, SIMD<int64_t,4> v1)
+      : m_val{_mm512_inserti64x4(_mm512_castsi256_si512(v0.val()), v1.val(), 1)} { }
+    SIMD (std::array<int64_t,8> a) : SIMD(a[0],a[1],a[2],a[3],a[4],a[5],a[6],a[7]) { }
+    SIMD (int64_t const * p) { m_val = _mm512_loadu_si512(p); }
+    SIMD (int64_t const * p, SIMD<mask64,8> mask) { m_val = _mm512_maskz_loadu_epi64(mask.val(), p); }
+
+    static constexpr int size() { return 8; }
+    auto val() const { return m_val; }
+    const int64_t * ptr() const { return (int64_t*)&m_val; }
+    SIMD<int64_t, 4> lo() const { return _mm512_castsi512_si256(m_val); }
+    SIMD<int64_t, 4> hi() const { return _mm512_extracti64x4_epi64(m_val, 1); }
+    int64_t operator[](size_t i) const { return detail::lane<int64_t>(m_val, i); }
+
+    void store (int64_t * p) const { _mm512_storeu_si512(p, m_val); }
+    void store (int64_t * p, SIMD<mask64,8> mask) const { _mm512_mask_storeu_epi64(p, mask.val(), m_val); }
+
+    static SIMD loadAligned (int64_t const * p) { return _mm512_load_si512(p); }
+    void storeAligned (int64_t * p) const { _mm512_store_si512(p, m_val); }
+    void storeStream (int64_t * p) const { _mm512_stream_si512((__m512i*)p, m_val); }
+  };
+
+
+
+  template <int64_t first>
+  class IndexSequence<int64_t, 8, first> : public SIMD<int64_t,8>
+  {
+  public:
+    IndexSequence()
+      : SIMD<int64_t,8> (first, first+1, first+2, first+3, first+4, first+5, first+6, first+7) { }
+  };
+
+
+
+  inline auto operator+ (SIMD<double,8> a, SIMD<double,8> b) { return SIMD<double,8> (_mm512_add_pd(a.val(), b.val())); }
+  inline auto operator- (SIMD<double,8> a, SIMD<double,8> b) { return SIMD<double,8> (_mm512_sub_pd(a.val(), b.val())); }
+
+  inline auto operator* (SIMD<double,8> a, SIMD<double,8> b) { return SIMD<double,8> (_mm512_mul_pd(a.val(), b.val())); }
+  inline auto operator* (double a, SIMD<double,8> b) { return SIMD<double,8>(a)*b; }
+
+  inline auto operator/ (SIMD<double,8> a, SIMD<double,8> b) { return SIMD<double,8> (_mm512_div_pd(a.val(), b.val())); }
+
+  // flip the sign bit, _mm512_xor_pd would need AVX512DQ
+  inline auto operator- (SIMD<double,8> a)
+  { return SIMD<double,8> (_mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a.val()), _mm512_set1_epi64(INT64_MIN)))); }
+
+  inline auto operator+ (SIMD<int64_t,8> a, SIMD<int64_t,8> b) { return SIMD<int64_t,8> (_mm512_add_epi64(a.val(), b.val())); }
+  inline auto operator- (SIMD<int64_t,8> a, SIMD<int64_t,8> b) { return SIMD<int64_t,8> (_mm512_sub_epi64(a.val(), b.val())); }
+
+  // a*b+c, AVX512F always comes with fma
+  inline SIMD<double,8> fma (SIMD<double,8> a, SIMD<double,8> b, SIMD<double,8> c)
+  { return _mm512_fmadd_pd (a.val(), b.val(), c.val()); }
+
+  inline SIMD<double,8> min (SIMD<double,8> a, SIMD<double,8> b) { return _mm512_min_pd(a.val(), b.val()); }
+  inline SIMD<double,8> max (SIMD<double,8> a, SIMD<double,8> b) { return _mm512_max_pd(a.val(), b.val()); }
+  inline SIMD<double,8> abs (SIMD<double,8> a) { return _mm512_abs_pd(a.val()); }
+  inline SIMD<double,8> sqrt (SIMD<double,8> a) { return _mm512_sqrt_pd(a.val()); }
+
+  inline SIMD<double,8> nearbyint (SIMD<double,8> a)
+  { return _mm512_roundscale_pd(a.val(), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+  inline SIMD<double,8> pow2i (SIMD<double,8> n)
+  {
+    __m512i bits = _mm512_castpd_si512(_mm512_add_pd(n.val(), _mm512_set1_pd(0x1.8p52+1023)));
+    return _mm512_castsi512_pd(_mm512_slli_epi64(bits, 52));
+  }
+
+  inline SIMD<double,8> exponent (SIMD<double,8> x) { return _mm512_getexp_pd(x.val()); }
+  inline SIMD<double,8> mantissa (SIMD<double,8> x)
+  { return _mm512_getmant_pd(x.val(), _MM_MANT_NORM_1_2, _MM_MANT_SIGN_src); }
+
+  inline SIMD<mask64,8> operator>= (SIMD<int64_t,8> a , SIMD<int64_t,8> b)
+  { return _mm512_cmpge_epi64_mask(a.val(), b.val()); }
+  inline SIMD<mask64,8> operator> (SIMD<int64_t,8> a , SIMD<int64_t,8> b)
+  { return _mm512_cmpgt_epi64_mask(a.val(), b.val()); }
+  inline SIMD<mask64,8> operator<= (SIMD<int64_t,8> a , SIMD<int64_t,8> b)
+  { return _mm512_cmple_epi64_mask(a.val(), b.val()); }
+  inline SIMD<mask64,8> operator< (SIMD<int64_t,8> a , SIMD<int64_t,8> b)
+  { return _mm512_cmplt_epi64_mask(a.val(), b.val()); }
+  inline SIMD<mask64,8> operator== (SIMD<int64_t,8> a , SIMD<int64_t,8> b)
+  { return _mm512_cmpeq_epi64_mask(a.val(), b.val()); }
+  inline SIMD<mask64,8> operator!= (SIMD<int64_t,8> a , SIMD<int64_t,8> b)
+  { return _mm512_cmpneq_epi64_mask(a.val(), b.val()); }
+
+  inline SIMD<mask64,8> operator>= (SIMD<double,8> a, SIMD<double,8> b)
+  { return _mm512_cmp_pd_mask (a.val(), b.val(), _CMP_GE_OQ); }
+  inline SIMD<mask64,8> operator> (SIMD<double,8> a, SIMD<double,8> b)
+  { return _mm512_cmp_pd_mask (a.val(), b.val(), _CMP_GT_OQ); }
+  inline SIMD<mask64,8> operator<= (SIMD<double,8> a, SIMD<double,8> b)
+  { return _mm512_cmp_pd_mask (a.val(), b.val(), _CMP_LE_OQ); }
+  inline SIMD<mask64,8> operator< (SIMD<double,8> a, SIMD<double,8> b)
+  { return _mm512_cmp_pd_mask (a.val(), b.val(), _CMP_LT_OQ); }
+  inline SIMD<mask64,8> operator== (SIMD<double,8> a, SIMD<double,8> b)
+  { return _mm512_cmp_pd_mask (a.val(), b.val(), _CMP_EQ_OQ); }
+  inline SIMD<mask64,8> operator!= (SIMD<double,8> a, SIMD<double,8> b)
+  { return _mm512_cmp_pd_mask (a.val(), b.val(), _CMP_NEQ_UQ); }
+
+
+  inline SIMD<mask64,8> operator&& (SIMD<mask64,8> a, SIMD<mask64,8> b) { return __mmask8(a.val() & b.val()); }
+  inline SIMD<mask64,8> operator|| (SIMD<mask64,8> a, SIMD<mask64,8> b) { return __mmask8(a.val() | b.val()); }
+  inline SIMD<mask64,8> operator! (SIMD<mask64,8> a) { return __mmask8(~a.val()); }
+
+
+  inline SIMD<double,8> select (SIMD<mask64,8> mask, SIMD<double,8> b, SIMD<double,8> c)
+  { return _mm512_mask_blend_pd(mask.val(), c.val(), b.val()); }
+
+
+  inline SIMD<double,8> gather (const double * p, SIMD<int64_t,8> idx)
+  { return _mm512_i64gather_pd(idx.val(), p, 8); }
+  inline SIMD<double,8> gather (const double * p, SIMD<int64_t,8> idx, SIMD<mask64,8> mask)
+  { return _mm512_mask_i64gather_pd(_mm512_setzero_pd(), mask.val(), idx.val(), p, 8); }
+
+  inline SIMD<int64_t,8> gather (const int64_t * p, SIMD<int64_t,8> idx)
+  { return _mm512_i64gather_epi64(idx.val(), p, 8); }
+  inline SIMD<int64_t,8> gather (const int64_t * p, SIMD<int64_t,8> idx, SIMD<mask64,8> mask)
+  { return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), mask.val(), idx.val(), p, 8); }
+
+  // conflicting indices are written in lane order, the highest lane wins
+  inline void scatter (double * p, SIMD<int64_t,8> idx, SIMD<double,8> val)
+  { _mm512_i64scatter_pd(p, idx.val(), val.val(), 8); }
+  inline void scatter (double * p, SIMD<int64_t,8> idx, SIMD<double,8> val, SIMD<mask64,8> mask)
+  { _mm512_mask_i64scatter_pd(p, mask.val(), idx.val(), val.val(), 8); }
+
+  inline void scatter (int64_t * p, SIMD<int64_t,8> idx, SIMD<int64_t,8> val)
+  { _mm512_i64scatter_epi64(p, idx.val(), val.val(), 8); }
+  inline void scatter (int64_t * p, SIMD<int64_t,8> idx, SIMD<int64_t,8> val, SIMD<mask64,8> mask)
+  { _mm512_mask_i64scatter_epi64(p, mask.val(), idx.val(), val.val(), 8); }
+
+
+  template <int I0, int I1, int I2, int I3, int I4, int I5, int I6, int I7>
+  SIMD<double,8> permute (SIMD<double,8> a)
+  { return _mm512_permutexvar_pd(_mm512_set_epi64(I7,I6,I5,I4,I3,I2,I1,I0), a.val()); }
+
+  template <int MASK>
+  SIMD<double,8> blend (SIMD<double,8> a, SIMD<double,8> b)
+  { return _mm512_mask_blend_pd(__mmask8(MASK), a.val(), b.val()); }
+
+  template <int L>
+  SIMD<double,8> broadcast (SIMD<double,8> a)
+  { return _mm512_permutexvar_pd(_mm512_set1_epi64(L), a.val()); }
+
+
+  inline double hSum (SIMD<double,8> a)
+  { return hSum(a.lo()+a.hi()); }
+
+  inline SIMD<double,2> hSum (SIMD<double,8> a, SIMD<double,8> b)
+  { return hSum(a.lo()+a.hi(), b.lo()+b.hi()); }
+
+  inline SIMD<double,4> hSum (SIMD<double,8> a0, SIMD<double,8> a1, SIMD<double,8> a2, SIMD<double,8> a3)
+  { return hSum(a0.lo()+a0.hi(), a1.lo()+a1.hi(), a2.lo()+a2.hi(), a3.lo()+a3.hi()); }
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef SIMD_LOOP_HPP
+#define SIMD_LOOP_HPP
+
+#include <utility>
+
+#include "simd.hpp"
+
+
+/*
+  loop drivers for arrays of arbitrary length n:
+
+  simdLoop<S> (n, [&](size_t i, auto mask) { ... });
+
+  calls the body for i = 0, S, 2S, ... Full chunks get a FullMask<S>,
+  the remainder gets a SIMD<mask64,S> selecting lanes i..n-1.
+  load / store / select / gather / scatter accept either, so one
+  generic body serves both, and full chunks use unmasked loads and
+  stores.
+
+  masks have 64-bit lanes, i.e. for double and int64_t arrays.
+ */
+
+
+namespace ASC_HPC
+{
+
+  // mask of a full chunk, all lanes active
+  template <size_t S>
+  class FullMask { };
+
+  template <typename T, size_t S>
+  auto load (const T * p, FullMask<S>) { return SIMD<T,S> (p); }
+  template <typename T, size_t S>
+  auto load (const T * p, SIMD<mask_t<T>,S> mask) { return SIMD<T,S> (p, mask); }
+
+  template <typename T, size_t S>
+  void store (T * p, SIMD<T,S> val, FullMask<S>) { val.store(p); }
+  template <typename T, size_t S>
+  void store (T * p, SIMD<T,S> val, SIMD<mask_t<T>,S> mask) { val.store(p, mask); }
+
+  template <typename T, size_t S>
+  auto select (FullMask<S>, SIMD<T,S> a, SIMD<T,S>) { return a; }
+
+  template <typename T, size_t S>
+  auto gather (const T * p, SIMD<int64_t,S> idx, FullMask<S>) { return gather(p, idx); }
+  template <typename T, size_t S>
+  void scatter (T * p, SIMD<int64_t,S> idx, SIMD<T,S> val, FullMask<S>) { scatter(p, idx, val); }
+
+
+  namespace detail
+  {
+    template <size_t S, typename FUNC, size_t... K>
+    void unrolledChunks (size_t i, FUNC & func, std::index_sequence<K...>)
+    { (func(i+K*S, FullMask<S>()), ...); }
+
+    template <size_t S, typename T, size_t U, typename FUNC, size_t... K>
+    void unrolledChunks (size_t i, std::array<SIMD<T,S>,U> & acc, FUNC & func, std::index_sequence<K...>)
+    { (func(i+K*S, FullMask<S>(), acc[K]), ...); }
+  }
+
+
+  // UNROLL > 1 calls the body for UNROLL consecutive chunks per iteration
+  template <size_t S, size_t UNROLL = 1, typename FUNC>
+  void simdLoop (size_t n, FUNC && func)
+  {
+    size_t i = 0;
+    for ( ; i+UNROLL*S <= n; i += UNROLL*S)
+      detail::unrolledChunks<S> (i, func, std::make_index_sequence<UNROLL>());
+    for ( ; i+S <= n; i += S)
+      func(i, FullMask<S>());
+    if (i < n)
+      func(i, IndexSequence<int64_t,S>() < SIMD<int64_t,S>(int64_t(n-i)));
+  }
+
+
+  // body (i, mask, acc) updates one of UNROLL independent accumulators,
+  // which breaks the dependency chain of acc = fma(x,y,acc).
+  // masked-out lanes must leave acc unchanged (masked loads give 0).
+  // returns the sum of the accumulators
+  template <size_t S, size_t UNROLL = 1, typename T, typename FUNC>
+  SIMD<T,S> simdReduce (size_t n, SIMD<T,S> init, FUNC && func)
+  {
+    std::array<SIMD<T,S>,UNROLL> acc;
+    acc.fill(init);
+
+    size_t i = 0;
+    for ( ; i+UNROLL*S <= n; i += UNROLL*S)
+      detail::unrolledChunks<S> (i, acc, func, std::make_index_sequence<UNROLL>());
+    for ( ; i+S <= n; i += S)
+      func(i, FullMask<S>(), acc[0]);
+    if (i < n)
+      func(i, IndexSequence<int64_t,S>() < SIMD<int64_t,S>(int64_t(n-i)), acc[0]);
+
+    for (size_t k = 1; k < UNROLL; k++)
+      acc[0] += acc[k];
+    return acc[0];
+  }
+
+
+  // out[i] = func(in[i]...), element-wise over n entries
+  template <size_t S, size_t UNROLL = 1, typename T, typename FUNC, typename ...TIN>
+  void simdTransform (size_t n, FUNC && func, T * out, const TIN*... in)
+  {
+    simdLoop<S,UNROLL> (n, [&](size_t i, auto mask)
+    {
+      store(out+i, func(load(in+i, mask)...), mask);
+    });
+  }
+
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef SIMD_MATH_HPP
+#define SIMD_MATH_HPP
+
+#include <limits>
+
+#include "simd.hpp"
+
+
+/*
+  vectorized elementary functions for SIMD<double,S>
+
+  written once against the generic SIMD interface (fma, select,
+  nearbyint, pow2i, exponent, mantissa), so every backend and the
+  generic recursion get them.
+
+  max. errors, measured against glibc on random arguments
+  (see demos/simd_timings.cpp):
+
+    exp  :  1 ulp, full range, results below 2^-1022 are subnormal
+    log  :  1 ulp, x < 0 gives NaN, log(0) = -inf
+    sin  :  1 ulp for |x| < 4, 2 ulp for |x| < 1e5, degrades beyond
+    cos  :  1 ulp for |x| < 4, 2 ulp for |x| < 1e5, degrades beyond
+    pow  :  exp(y*log(x)), error grows like |y*log(x)| ulp
+            (about 30 ulp for y = 2.5), x >= 0 only
+ */
+
+
+namespace ASC_HPC
+{
+
+  namespace detail
+  {
+    // c0 + x*(c1 + x*(c2 + ...)), unrolled at compile time
+    template <typename V>
+    V horner (V x, double c0) { return V(c0); }
+
+    template <typename V, typename ...Cs>
+    V horner (V x, double c0, Cs... cs) { return fma(horner(x, cs...), x, V(c0)); }
+
+
+    // sin and cos for |r| <= pi/4, Taylor polynomials in z = r*r
+    template <typename V>
+    V sinPoly (V r)
+    {
+      V z = r*r;
+      V p = horner(z, -1.0/6, 1.0/120, -1.0/5040, 1.0/362880, -1.0/39916800,
+                   1.0/6227020800, -1.0/1307674368000, 1.0/355687428096000);
+      return fma(r*z, p, r);
+    }
+
+    template <typename V>
+    V cosPoly (V r)
+    {
+      V z = r*r;
+      V p = horner(z, -1.0/2, 1.0/24, -1.0/720, 1.0/40320, -1.0/3628800,
+                   1.0/479001600, -1.0/87178291200, 1.0/20922789888000,
+                   -1.0/6402373705728000);
+      return fma(z, p, V(1.0));
+    }
+
+    // x = k*pi/2 + r, quadrant = (k+offset) mod 4, cos(x) = sin(x+pi/2)
+    template <typename V>
+    V sinQuadrant (V x, double offset)
+    {
+      // pi/2 split in three parts (fdlibm), each product k*pio2_i is exact
+      V k = nearbyint(V(0.6366197723675814) * x);
+      V r = fma(k, V(-1.57079632673412561417e+00), x);
+      r = fma(k, V(-6.07710050630396597660e-11), r);
+      r = fma(k, V(-2.02226624871116645580e-21), r);
+
+      // floor((k+offset)/4) = nearbyint((k+offset)/4 - 3/8), no ties possible
+      V kq = k + V(offset);
+      V q = kq - V(4.0) * nearbyint(V(0.25)*kq - V(0.375));
+
+      auto useCos = (q == V(1.0)) || (q == V(3.0));
+      V res = select(useCos, cosPoly(r), sinPoly(r));
+      return select(q >= V(2.0), -res, res);
+    }
+  }
+
+
+  template <size_t S>
+  SIMD<double,S> exp (SIMD<double,S> x)
+  {
+    using V = SIMD<double,S>;
+
+    // x = k*ln2 + r, |r| <= ln2/2, ln2 split in hi and lo part
+    V k = nearbyint(V(1.4426950408889634) * x);
+    V r = fma(k, V(-6.93147180369123816490e-01), x);
+    r = fma(k, V(-1.90821492927058770002e-10), r);
+
+    V p = detail::horner(r, 1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720,
+                         1.0/5040, 1.0/40320, 1.0/362880, 1.0/3628800,
+                         1.0/39916800, 1.0/479001600, 1.0/6227020800);
+
+    // scale by 2^k in two steps, then 2^k1, 2^k2 stay in the normal range
+    V k1 = nearbyint(V(0.5) * k);
+    V res = p * pow2i(k1) * pow2i(k-k1);
+
+    res = select(x > V(709.782712893384), V(std::numeric_limits<double>::infinity()), res);
+    return select(x < V(-745.1332191019412), V(0.0), res);
+  }
+
+
+  template <size_t S>
+  SIMD<double,S> log (SIMD<double,S> x)
+  {
+    using V = SIMD<double,S>;
+
+    // subnormals are scaled into the normal range first
+    auto tiny = x < V(std::numeric_limits<double>::min());
+    V xs = select(tiny, V(0x1p54) * x, x);
+    V e = exponent(xs) - select(tiny, V(54.0), V(0.0));
+    V m = mantissa(xs);
+
+    // m in [sqrt(2)/2, sqrt(2))
+    auto big = m > V(1.4142135623730951);
+    m = select(big, V(0.5) * m, m);
+    e = select(big, e + V(1.0), e);
+
+    // log(1+f) = f - hfsq + s*(hfsq+R),  s = f/(2+f),  R = 2 s^2/3 + 2 s^4/5 + ...
+    V f = m - V(1.0);
+    V s = f / (V(2.0) + f);
+    V z = s*s;
+    V R = z * detail::horner(z, 2.0/3, 2.0/5, 2.0/7, 2.0/9, 2.0/11, 2.0/13,
+                             2.0/15, 2.0/17, 2.0/19, 2.0/21, 2.0/23);
+    V hfsq = V(0.5) * f * f;
+    V res = fma(e, V(6.93147180369123816490e-01),
+                f - (hfsq - fma(s, hfsq + R, e * V(1.90821492927058770002e-10))));
+
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    res = select(x == V(inf), x, res);
+    res = select(x == V(0.0), V(-inf), res);
+    res = select(x < V(0.0), V(std::numeric_limits<double>::quiet_NaN()), res);
+    return select(x != x, x, res);
+  }
+
+
+  template <size_t S>
+  SIMD<double,S> sin (SIMD<double,S> x) { return detail::sinQuadrant(x, 0.0); }
+
+  template <size_t S>
+  SIMD<double,S> cos (SIMD<double,S> x) { return detail::sinQuadrant(x, 1.0); }
+
+
+  template <size_t S>
+  SIMD<double,S> pow (SIMD<double,S> x, SIMD<double,S> y)
+  {
+    using V = SIMD<double,S>;
+    return select(y == V(0.0), V(1.0), exp(y * log(x)));
+  }
+
+}
+
+#endif
@@ -0,0 +1,432 @@
+#ifndef SIMD_SSE_HPP
+#define SIMD_SSE_HPP
+
+#include <immintrin.h>
+
+
+/*
+  implementation of 128-bit SIMDs for Intel-CPUs with SSE2 support
+  (available on every x86_64 CPU):
+  https://www.intel.com/content/www/us/en/docs/intrinsics-guide/index.html
+
+  the AVX types are built from two of these halves
+ */
+
+
+namespace ASC_HPC
+{
+
+  template<>
+  class SIMD<mask64,2>
+  {
+    __m128i m_mask;
+  public:
+
+    SIMD (__m128i mask) : m_mask(mask) { };
+    SIMD (__m128d mask) : m_mask(_mm_castpd_si128(mask)) { ; }
+    SIMD (SIMD<mask64,1> v0, SIMD<mask64,1> v1)
+      : m_mask{_mm_set_epi64x(v1.val().val(), v0.val().val())} { }
+    auto val() const { return m_mask; }
+    mask64 operator[](size_t i) const { return detail::lane<int64_t>(m_mask, i) != 0; }
+
+    SIMD<mask64, 1> lo() const { return SIMD<mask64,1>((*this)[0]); }
+    SIMD<mask64, 1> hi() const { return SIMD<mask64,1>((*this)[1]); }
+    const mask64 * ptr() const { return (mask64*)&m_mask; }
+  };
+
+
+
+  template<>
+  class SIMD<double,2>
+  {
+    __m128d m_val;
+  public:
+    SIMD () = default;
+    SIMD (const SIMD &) = default;
+    SIMD(double val) : m_val{_mm_set1_pd(val)} {};
+    SIMD(__m128d val) : m_val{val} {};
+    SIMD (double v0, double v1) : m_val{_mm_set_pd(v1,v0)} {  }
+    SIMD (SIMD<double,1> v0, SIMD<double,1> v1) : SIMD(v0.val(), v1.val()) { }
+    SIMD (std::array<double,2> a) : SIMD(a[0],a[1]) { }
+    SIMD (double const * p) { m_val = _mm_loadu_pd(p); }
+    SIMD (double const * p, SIMD<mask64,2> mask)
+    {
+#ifdef __AVX__
+      m_val = _mm_maskload_pd(p, mask.val());
+#else
+      // no masked load before AVX, must not touch masked-out entries
+      m_val = _mm_set_pd(mask[1] ? p[1] : 0.0, mask[0] ? p[0] : 0.0);
+#endif
+    }
+
+    static constexpr int size() { return 2; }
+    auto val() const { return m_val; }
+    const double * ptr() const { return (double*)&m_val; }
+    SIMD<double, 1> lo() const { return _mm_cvtsd_f64(m_val); }
+    SIMD<double, 1> hi() const { return _mm_cvtsd_f64(_mm_unpackhi_pd(m_val, m_val)); }
+    double operator[](size_t i) const { return ((double*)&m_val)[i]; }
+
+    void store (double * p) const { _mm_storeu_pd(p, m_val); }
+
+    static SIMD loadAligned (double const * p) { return _mm_load_pd(p); }
+    void storeAligned (double * p) const { _mm_store_pd(p, m_val); }
+    void storeStream (double * p) const { _mm_stream_pd(p, m_val); }
+    void store (double * p, SIMD<mask64,2> mask) const
+    {
+#ifdef __AVX__
+      _mm_maskstore_pd(p, mask.val(), m_val);
+#else
+      if (mask[0]) p[0] = (*this)[0];
+      if (mask[1]) p[1] = (*this)[1];
+#endif
+    }
+  };
+
+
+
+  template<>
+  class SIMD<int64_t,2>
+  {
+    __m128i m_val;
+  public:
+    SIMD () = default;
+    SIMD (const SIMD &) = default;
+    SIMD(int64_t val) : m_val{_mm_set1_epi64x(val)} {};
+    SIMD(__m128i val) : m_val{val} {};
+    SIMD (int64_t v0, int64_t v1) : m_val{_mm_set_epi64x(v1,v0) } { }
+    SIMD (SIMD<int64_t,1> v0, SIMD<int64_t,1> v1) : SIMD(v0.val(), v1.val()) { }
+    SIMD (std::array<int64_t,2> a) : SIMD(a[0],a[1]) { }
+    SIMD (int64_t const * p) { m_val = _mm_loadu_si128((__m128i const*)p); }
+    SIMD (int64_t const * p, SIMD<mask64,2> mask)
+    {
+#ifdef __AVX2__
+      m_val = _mm_maskload_epi64((long long const*)p, mask.val());
+#else
+      m_val = _mm_set_epi64x(mask[1] ? p[1] : 0, mask[0] ? p[0] : 0);
+#endif
+    }
+
+    static constexpr int size() { return 2; }
+    auto val() const { return m_val; }
+    const int64_t * ptr() const { return (int64_t*)&m_val; }
+    SIMD<int64_t, 1> lo() const { return (*this)[0]; }
+    SIMD<int64_t, 1> hi() const { return (*this)[1]; }
+    int64_t operator[](size_t i) const { return detail::lane<int64_t>(m_val, i); }
+
+    void store (int64_t * p) const { _mm_storeu_si128((__m128i*)p, m_val); }
+    void store (int64_t * p, SIMD<mask64,2> mask) const
+    {
+#ifdef __AVX2__
+      _mm_maskstore_epi64((long long*)p, mask.val(), m_val);
+#else
+      if (mask[0]) p[0] = (*this)[0];
+      if (mask[1]) p[1] = (*this)[1];
+#endif
+    }
+
+    static SIMD loadAligned (int64_t const * p) { return _mm_load_si128((__m128i const*)p); }
+    void storeAligned (int64_t * p) const { _mm_store_si128((__m128i*)p, m_val); }
+    void storeStream (int64_t * p) const { _mm_stream_si128((__m128i*)p, m_val); }
+  };
+
+
+
+  template<>
+  class SIMD<mask32,4>
+  {
+    __m128i m_mask;
+  public:
+
+    SIMD (__m128i mask) : m_mask(mask) { };
+    SIMD (__m128 mask) : m_mask(_mm_castps_si128(mask)) { ; }
+    SIMD (SIMD<mask32,2> v0, SIMD<mask32,2> v1)
+      : m_mask{_mm_set_epi32(v1[1].val(), v1[0].val(), v0[1].val(), v0[0].val())} { }
+    auto val() const { return m_mask; }
+    mask32 operator[](size_t i) const { return detail::lane<int32_t>(m_mask, i) != 0; }
+
+    SIMD<mask32, 2> lo() const { return SIMD<mask32,2>((*this)[0], (*this)[1]); }
+    SIMD<mask32, 2> hi() const { return SIMD<mask32,2>((*this)[2], (*this)[3]); }
+    const mask32 * ptr() const { return (mask32*)&m_mask; }
+  };
+
+
+
+  template<>
+  class SIMD<float,4>
+  {
+    __m128 m_val;
+  public:
+    SIMD () = default;
+    SIMD (const SIMD &) = default;
+    SIMD(float val) : m_val{_mm_set1_ps(val)} {};
+    SIMD(__m128 val) : m_val{val} {};
+    SIMD (float v0, float v1, float v2, float v3) : m_val{_mm_set_ps(v3,v2,v1,v0)} {  }
+    SIMD (SIMD<float,2> v0, SIMD<float,2> v1) : SIMD(v0[0], v0[1], v1[0], v1[1]) { }
+    SIMD (std::array<float,4> a) : SIMD(a[0],a[1],a[2],a[3]) { }
+    SIMD (float const * p) { m_val = _mm_loadu_ps(p); }
+    SIMD (float const * p, SIMD<mask32,4> mask)
+    {
+#ifdef __AVX__
+      m_val = _mm_maskload_ps(p, mask.val());
+#else
+      m_val = _mm_set_ps(mask[3] ? p[3] : 0.0f, mask[2] ? p[2] : 0.0f,
+                         mask[1] ? p[1] : 0.0f, mask[0] ? p[0] : 0.0f);
+#endif
+    }
+
+    static constexpr int size() { return 4; }
+    auto val() const { return m_val; }
+    const float * ptr() const { return (float*)&m_val; }
+    SIMD<float, 2> lo() const { return SIMD<float,2>((*this)[0], (*this)[1]); }
+    SIMD<float, 2> hi() const { return SIMD<float,2>((*this)[2], (*this)[3]); }
+    float operator[](size_t i) const { return ((float*)&m_val)[i]; }
+
+    void store (float * p) const { _mm_storeu_ps(p, m_val); }
+
+    static SIMD loadAligned (float const * p) { return _mm_load_ps(p); }
+    void storeAligned (float * p) const { _mm_store_ps(p, m_val); }
+    void storeStream (float * p) const { _mm_stream_ps(p, m_val); }
+    void store (float * p, SIMD<mask32,4> mask) const
+    {
+#ifdef __AVX__
+      _mm_maskstore_ps(p, mask.val(), m_val);
+#else
+      for (size_t i = 0; i < 4; i++)
+        if (mask[i]) p[i] = (*this)[i];
+#endif
+    }
+  };
+
+
+
+  template <int64_t first>
+  class IndexSequence<int64_t, 2, first> : public SIMD<int64_t,2>
+  {
+  public:
+    IndexSequence()
+      : SIMD<int64_t,2> (first, first+1) { }
+  };
+
+
+
+  inline auto operator+ (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<double,2> (_mm_add_pd(a.val(), b.val())); }
+  inline auto operator- (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<double,2> (_mm_sub_pd(a.val(), b.val())); }
+
+  inline auto operator* (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<double,2> (_mm_mul_pd(a.val(), b.val())); }
+  inline auto operator* (double a, SIMD<double,2> b) { return SIMD<double,2>(a)*b; }
+
+  inline auto operator+ (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<float,4> (_mm_add_ps(a.val(), b.val())); }
+  inline auto operator- (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<float,4> (_mm_sub_ps(a.val(), b.val())); }
+
+  inline auto operator* (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<float,4> (_mm_mul_ps(a.val(), b.val())); }
+  inline auto operator* (float a, SIMD<float,4> b) { return SIMD<float,4>(a)*b; }
+
+  inline auto operator/ (SIMD<double,2> a, SIMD<double,2> b) { return SIMD<double,2> (_mm_div_pd(a.val(), b.val())); }
+  inline auto operator/ (SIMD<float,4> a, SIMD<float,4> b) { return SIMD<float,4> (_mm_div_ps(a.val(), b.val())); }
+
+  // flip the sign bit
+  inline auto operator- (SIMD<double,2> a) { return SIMD<double,2> (_mm_xor_pd(a.val(), _mm_set1_pd(-0.0))); }
+  inline auto operator- (SIMD<float,4> a) { return SIMD<float,4> (_mm_xor_ps(a.val(), _mm_set1_ps(-0.0f))); }
+
+  inline auto operator+ (SIMD<int64_t,2> a, SIMD<int64_t,2> b) { return SIMD<int64_t,2> (_mm_add_epi64(a.val(), b.val())); }
+  inline auto operator- (SIMD<int64_t,2> a, SIMD<int64_t,2> b) { return SIMD<int64_t,2> (_mm_sub_epi64(a.val(), b.val())); }
+
+  // a*b+c
+  inline SIMD<double,2> fma (SIMD<double,2> a, SIMD<double,2> b, SIMD<double,2> c)
+  {
+#ifdef __FMA__
+    return _mm_fmadd_pd (a.val(), b.val(), c.val());
+#else
+    return _mm_add_pd (_mm_mul_pd(a.val(), b.val()), c.val());
+#endif
+  }
+
+  inline SIMD<float,4> fma (SIMD<float,4> a, SIMD<float,4> b, SIMD<float,4> c)
+  {
+#ifdef __FMA__
+    return _mm_fmadd_ps (a.val(), b.val(), c.val());
+#else
+    return _mm_add_ps (_mm_mul_ps(a.val(), b.val()), c.val());
+#endif
+  }
+
+  inline SIMD<double,2> min (SIMD<double,2> a, SIMD<double,2> b) { return _mm_min_pd(a.val(), b.val()); }
+  inline SIMD<double,2> max (SIMD<double,2> a, SIMD<double,2> b) { return _mm_max_pd(a.val(), b.val()); }
+  inline SIMD<double,2> abs (SIMD<double,2> a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.val()); }
+  inline SIMD<double,2> sqrt (SIMD<double,2> a) { return _mm_sqrt_pd(a.val()); }
+
+  inline SIMD<double,2> nearbyint (SIMD<double,2> a)
+  {
+#ifdef __SSE4_1__
+    return _mm_round_pd(a.val(), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+#else
+    return SIMD<double,2> (std::nearbyint(a[0]), std::nearbyint(a[1]));
+#endif
+  }
+
+  // n+1023 lands in the low mantissa bits of 1.5*2^52+1023+n, shift it into the exponent
+  inline SIMD<double,2> pow2i (SIMD<double,2> n)
+  {
+    __m128i bits = _mm_castpd_si128(_mm_add_pd(n.val(), _mm_set1_pd(0x1.8p52+1023)));
+    return _mm_castsi128_pd(_mm_slli_epi64(bits, 52));
+  }
+
+  // biased exponent or'ed into the mantissa of 2^52 gives the double 2^52+e+1023
+  inline SIMD<double,2> exponent (SIMD<double,2> x)
+  {
+    __m128i bits = _mm_or_si128(_mm_srli_epi64(_mm_castpd_si128(x.val()), 52),
+                                _mm_castpd_si128(_mm_set1_pd(0x1p52)));
+    return _mm_sub_pd(_mm_castsi128_pd(bits), _mm_set1_pd(0x1p52+1023));
+  }
+
+  inline SIMD<double,2> mantissa (SIMD<double,2> x)
+  {
+    __m128d mant = _mm_castsi128_pd(_mm_set1_epi64x(0x000fffffffffffff));
+    return _mm_or_pd(_mm_and_pd(x.val(), mant), _mm_set1_pd(1.0));
+  }
+
+  inline SIMD<float,4> min (SIMD<float,4> a, SIMD<float,4> b) { return _mm_min_ps(a.val(), b.val()); }
+  inline SIMD<float,4> max (SIMD<float,4> a, SIMD<float,4> b) { return _mm_max_ps(a.val(), b.val()); }
+  inline SIMD<float,4> abs (SIMD<float,4> a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.val()); }
+  inline SIMD<float,4> sqrt (SIMD<float,4> a) { return _mm_sqrt_ps(a.val()); }
+
+  inline auto operator>= (SIMD<double,2> a, SIMD<double,2> b)
+  { return SIMD<mask64,2>(_mm_cmpge_pd (a.val(), b.val())); }
+  inline auto operator> (SIMD<double,2> a, SIMD<double,2> b)
+  { return SIMD<mask64,2>(_mm_cmpgt_pd (a.val(), b.val())); }
+  inline auto operator<= (SIMD<double,2> a, SIMD<double,2> b)
+  { return SIMD<mask64,2>(_mm_cmple_pd (a.val(), b.val())); }
+  inline auto operator< (SIMD<double,2> a, SIMD<double,2> b)
+  { return SIMD<mask64,2>(_mm_cmplt_pd (a.val(), b.val())); }
+  inline auto operator== (SIMD<double,2> a, SIMD<double,2> b)
+  { return SIMD<mask64,2>(_mm_cmpeq_pd (a.val(), b.val())); }
+  inline auto operator!= (SIMD<double,2> a, SIMD<double,2> b)
+  { return SIMD<mask64,2>(_mm_cmpneq_pd (a.val(), b.val())); }
+
+  inline auto operator>= (SIMD<float,4> a, SIMD<float,4> b)
+  { return SIMD<mask32,4>(_mm_cmpge_ps (a.val(), b.val())); }
+  inline auto operator> (SIMD<float,4> a, SIMD<float,4> b)
+  { return SIMD<mask32,4>(_mm_cmpgt_ps (a.val(), b.val())); }
+  inline auto operator<= (SIMD<float,4> a, SIMD<float,4> b)
+  { return SIMD<mask32,4>(_mm_cmple_ps (a.val(), b.val())); }
+  inline auto operator< (SIMD<float,4> a, SIMD<float,4> b)
+  { return SIMD<mask32,4>(_mm_cmplt_ps (a.val(), b.val())); }
+  inline auto operator== (SIMD<float,4> a, SIMD<float,4> b)
+  { return SIMD<mask32,4>(_mm_cmpeq_ps (a.val(), b.val())); }
+  inline auto operator!= (SIMD<float,4> a, SIMD<float,4> b)
+  { return SIMD<mask32,4>(_mm_cmpneq_ps (a.val(), b.val())); }
+
+#ifdef __SSE4_1__
+  inline SIMD<mask64,2> operator== (SIMD<int64_t,2> a , SIMD<int64_t,2> b)
+  { return _mm_cmpeq_epi64(a.val(), b.val()); }
+  inline SIMD<mask64,2> operator!= (SIMD<int64_t,2> a , SIMD<int64_t,2> b)
+  { return _mm_xor_si128(_mm_cmpeq_epi64(a.val(),b.val()),_mm_set1_epi32(-1)); }
+#endif
+
+#ifdef __SSE4_2__
+  inline SIMD<mask64,2> operator>= (SIMD<int64_t,2> a , SIMD<int64_t,2> b)
+  { // there is no a>=b, so we return !(b>a)
+    return  _mm_xor_si128(_mm_cmpgt_epi64(b.val(),a.val()),_mm_set1_epi32(-1)); }
+  inline SIMD<mask64,2> operator> (SIMD<int64_t,2> a , SIMD<int64_t,2> b)
+  { return _mm_cmpgt_epi64(a.val(), b.val()); }
+  inline SIMD<mask64,2> operator<= (SIMD<int64_t,2> a , SIMD<int64_t,2> b)
+  { return _mm_xor_si128(_mm_cmpgt_epi64(a.val(),b.val()),_mm_set1_epi32(-1)); }
+  inline SIMD<mask64,2> operator< (SIMD<int64_t,2> a , SIMD<int64_t,2> b)
+  { return _mm_cmpgt_epi64(b.val(), a.val()); }
+#endif
+
+
+  inline SIMD<mask64,2> operator&& (SIMD<mask64,2> a, SIMD<mask64,2> b) { return _mm_and_si128(a.val(), b.val()); }
+  inline SIMD<mask64,2> operator|| (SIMD<mask64,2> a, SIMD<mask64,2> b) { return _mm_or_si128(a.val(), b.val()); }
+  inline SIMD<mask64,2> operator! (SIMD<mask64,2> a) { return _mm_xor_si128(a.val(), _mm_set1_epi32(-1)); }
+
+  inline SIMD<mask32,4> operator&& (SIMD<mask32,4> a, SIMD<mask32,4> b) { return _mm_and_si128(a.val(), b.val()); }
+  inline SIMD<mask32,4> operator|| (SIMD<mask32,4> a, SIMD<mask32,4> b) { return _mm_or_si128(a.val(), b.val()); }
+  inline SIMD<mask32,4> operator! (SIMD<mask32,4> a) { return _mm_xor_si128(a.val(), _mm_set1_epi32(-1)); }
+
+
+  inline SIMD<double,2> select (SIMD<mask64,2> mask, SIMD<double,2> b, SIMD<double,2> c)
+  {
+#ifdef __SSE4_1__
+    return _mm_blendv_pd(c.val(), b.val(), _mm_castsi128_pd(mask.val()));
+#else
+    __m128d m = _mm_castsi128_pd(mask.val());
+    return _mm_or_pd(_mm_and_pd(m, b.val()), _mm_andnot_pd(m, c.val()));
+#endif
+  }
+
+
+  inline SIMD<float,4> select (SIMD<mask32,4> mask, SIMD<float,4> b, SIMD<float,4> c)
+  {
+#ifdef __SSE4_1__
+    return _mm_blendv_ps(c.val(), b.val(), _mm_castsi128_ps(mask.val()));
+#else
+    __m128 m = _mm_castsi128_ps(mask.val());
+    return _mm_or_ps(_mm_and_ps(m, b.val()), _mm_andnot_ps(m, c.val()));
+#endif
+  }
+
+#ifdef __AVX2__
+  // hardware gather came with AVX2, otherwise the generic lane-wise version is used
+  inline SIMD<double,2> gather (const double * p, SIMD<int64_t,2> idx)
+  { return _mm_i64gather_pd(p, idx.val(), 8); }
+  inline SIMD<double,2> gather (const double * p, SIMD<int64_t,2> idx, SIMD<mask64,2> mask)
+  { return _mm_mask_i64gather_pd(_mm_setzero_pd(), p, idx.val(), _mm_castsi128_pd(mask.val()), 8); }
+
+  inline SIMD<int64_t,2> gather (const int64_t * p, SIMD<int64_t,2> idx)
+  { return _mm_i64gather_epi64((const long long*)p, idx.val(), 8); }
+  inline SIMD<int64_t,2> gather (const int64_t * p, SIMD<int64_t,2> idx, SIMD<mask64,2> mask)
+  { return _mm_mask_i64gather_epi64(_mm_setzero_si128(), (const long long*)p, idx.val(), mask.val(), 8); }
+#endif
+
+
+  template <int I0, int I1>
+  SIMD<double,2> permute (SIMD<double,2> a) { return _mm_shuffle_pd(a.val(), a.val(), I0 | (I1 << 1)); }
+
+  template <int MASK>
+  SIMD<double,2> blend (SIMD<double,2> a, SIMD<double,2> b)
+  { return _mm_shuffle_pd((MASK & 1) ? b.val() : a.val(), (MASK & 2) ? b.val() : a.val(), 2); }
+
+  template <int L>
+  SIMD<double,2> broadcast (SIMD<double,2> a) { return permute<L,L> (a); }
+
+
+  // streaming stores are weakly ordered, fence before other threads read the data
+  inline void streamFence() { _mm_sfence(); }
+
+
+  inline double hSum (SIMD<double,2> a)
+  { return _mm_cvtsd_f64(_mm_add_sd(a.val(), _mm_unpackhi_pd(a.val(), a.val()))); }
+
+  inline SIMD<double,2> hSum (SIMD<double,2> a, SIMD<double,2> b)
+  { return _mm_add_pd(_mm_unpacklo_pd(a.val(), b.val()), _mm_unpackhi_pd(a.val(), b.val())); }
+
+  inline float hSum (SIMD<float,4> a)
+  {
+    __m128 sum = _mm_add_ps(a.val(), _mm_movehl_ps(a.val(), a.val()));
+    return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+  }
+
+  // (a0+a2, b0+b2, a1+a3, b1+b3), then add upper pair to lower pair
+  inline SIMD<float,2> hSum (SIMD<float,4> a, SIMD<float,4> b)
+  {
+    SIMD<float,4> sum = _mm_add_ps(_mm_unpacklo_ps(a.val(), b.val()), _mm_unpackhi_ps(a.val(), b.val()));
+    sum = _mm_add_ps(sum.val(), _mm_movehl_ps(sum.val(), sum.val()));
+    return SIMD<float,2>(sum[0], sum[1]);
+  }
+
+
+  // float <-> double conversion, one float vector fills two double vectors
+
+  inline SIMD<float,4> toFloat (SIMD<double,2> a, SIMD<double,2> b)
+  { return _mm_movelh_ps(_mm_cvtpd_ps(a.val()), _mm_cvtpd_ps(b.val())); }
+
+  inline auto toDouble (SIMD<float,4> a)
+  {
+    return std::tuple(SIMD<double,2>(_mm_cvtps_pd(a.val())),
+                      SIMD<double,2>(_mm_cvtps_pd(_mm_movehl_ps(a.val(), a.val()))));
+  }
+
+}
+
+#endif
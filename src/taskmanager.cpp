@@ -1,7 +1,25 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <vector>
 
-#include <concurrentqueue.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "taskmanager.hpp"
 #include "timer.hpp"
@@ -10,112 +28,1024 @@
 namespace ASC_HPC
 {
 
+  // one RunParallel call, lives in its frame until all tasks are done
+  class Batch
+  {
+  public:
+    detail::TaskFunction trampoline;
+    const void * func;
+    int size;
+    std::atomic<int> cnt{0};
+    size_t pushtime = 0;   // time counter at spawn, 0 if not measured
+    int trace_id = 0;      // link key of task 0
+    int profile_path = 0;  // call-tree node of the spawning region
+  };
+
   class Task
   {
   public:
-    int nr, size;
-    const std::function<void(int nr, int size)> * pfunc;
-    std::atomic<int> * cnt;
+    int nr;
+    Batch * batch;
+  };
+
+
+  /*
+    Chase-Lev work-stealing deque, memory orderings from
+    Le, Pop, Cohen, Zappa Nardelli: "Correct and Efficient Work-Stealing
+    for Weak Memory Models", PPoPP 2013.
+
+    The owner pushes and pops at the bottom (LIFO), thieves steal at
+    the top (FIFO). The deque holds pointers to tasks, the tasks live in
+    the frame of the RunParallel call which waits for all of them.
+  */
+  class WorkStealingDeque
+  {
+    class Array
+    {
+      int64_t mask;
+      std::unique_ptr<std::atomic<Task*>[]> data;
+    public:
+      Array (int64_t capacity)
+        : mask(capacity-1), data(new std::atomic<Task*>[capacity]) { }
+
+      int64_t capacity() const { return mask+1; }
+      Task * get (int64_t i) const { return data[i & mask].load(std::memory_order_relaxed); }
+      void put (int64_t i, Task * task) { data[i & mask].store(task, std::memory_order_relaxed); }
+
+      Array * grow (int64_t bottom, int64_t top) const
+      {
+        Array * a = new Array(2*capacity());
+        for (int64_t i = top; i < bottom; i++)
+          a->put(i, get(i));
+        return a;
+      }
+    };
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Array*> array;
+    // old arrays may still be read by thieves, freed with the deque
+    std::vector<std::unique_ptr<Array>> garbage;
+
+  public:
+    WorkStealingDeque (int64_t capacity = 1024)
+    {
+      garbage.emplace_back(new Array(capacity));
+      array = garbage.back().get();
+    }
+
+    // owner only
+    void push (Task * task)
+    {
+      pushBulk (task, 1);
+    }
+
+    // owner only, pushes &tasks[n-1], ..., &tasks[0] and publishes them at once,
+    // such that the owner pops tasks[0] first and thieves take tasks[n-1] first
+    void pushBulk (Task * tasks, int64_t n)
+    {
+      int64_t b = bottom.load(std::memory_order_relaxed);
+      int64_t t = top.load(std::memory_order_acquire);
+      Array * a = array.load(std::memory_order_relaxed);
+      if (b+n-t > a->capacity())
+        {
+          while (b+n-t > a->capacity())
+            {
+              a = a->grow(b, t);
+              garbage.emplace_back(a);
+            }
+          array.store(a, std::memory_order_release);
+        }
+      for (int64_t i = 0; i < n; i++)
+        a->put(b+i, &tasks[n-1-i]);
+      bottom.store(b+n, std::memory_order_release);
+    }
 
-    Task & operator++(int)
+    // owner only
+    Task * pop ()
     {
-      nr++;
-      return *this;
+      int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+      Array * a = array.load(std::memory_order_relaxed);
+      bottom.store(b, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t t = top.load(std::memory_order_relaxed);
+
+      if (t > b)
+        {
+          bottom.store(b+1, std::memory_order_relaxed);
+          return nullptr;
+        }
+
+      Task * task = a->get(b);
+      if (t == b)
+        {
+          // last entry, race against thieves
+          if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            task = nullptr;
+          bottom.store(b+1, std::memory_order_relaxed);
+        }
+      return task;
+    }
+
+    // any thread, a snapshot only
+    bool empty () const
+    {
+      return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire);
+    }
+
+    // any thread
+    Task * steal ()
+    {
+      int64_t t = top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t b = bottom.load(std::memory_order_acquire);
+      if (t >= b) return nullptr;
+
+      Task * task = array.load(std::memory_order_acquire)->get(t);
+      if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+      return task;
     }
-    Task & operator*() { return *this; }
   };
 
-  
-  typedef moodycamel::ConcurrentQueue<Task> TQueue; 
-  typedef moodycamel::ProducerToken TPToken; 
-  typedef moodycamel::ConsumerToken TCToken; 
-  
-  
+
+
   static std::atomic<bool> stop{false};
   static std::vector<std::thread> threads;
-  static TQueue queue;
-  
-  void StartWorkers(int num)
+
+  // deques[0] belongs to the thread calling StartWorkers, deques[i] to worker i.
+  // Other threads have id -1 and no deque, only its owner may push and pop
+  static std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+  static thread_local int thread_id = -1;
+
+  // tasks spawned by threads outside the pool, taken by anyone looking for work
+  static std::mutex injection_mutex;
+  static std::deque<Task*> injection;
+  static std::atomic<size_t> num_injected{0};
+
+  // a task for exactly this thread, see RunOnEachThread
+  struct alignas(64) Mailbox
+  {
+    std::atomic<Task*> task{nullptr};
+  };
+  static std::unique_ptr<Mailbox[]> mailboxes;
+
+
+
+  // per-thread counters, written by their thread only, others may read
+  struct alignas(64) ThreadCounters
+  {
+    std::atomic<size_t> tasks{0}, steals{0}, failed_dequeues{0},
+      idle_ticks{0}, parks{0}, queue_wait{0};
+  };
+  static std::unique_ptr<ThreadCounters[]> counters;
+
+  // threads outside the pool count into their own, unreported slot
+  static ThreadCounters & myCounters()
+  {
+    static thread_local ThreadCounters outside;
+    return (thread_id >= 0) ? counters[thread_id] : outside;
+  }
+  static std::vector<TaskStatistics> final_statistics;
+  static size_t start_ticks;
+  static std::chrono::steady_clock::time_point start_time;
+
+  static TaskInstrumentation instrumentation;
+  static std::atomic<int> link_keys{0};
+
+  static inline void count (std::atomic<size_t> & counter, size_t n = 1)
+  {
+    counter.store(counter.load(std::memory_order_relaxed)+n, std::memory_order_relaxed);
+  }
+
+  static Timer & taskTimer()
+  {
+    static Timer t("task", { 0.5, 0.5, 0.5 });
+    return t;
+  }
+
+  // a new batch, before any of its tasks is pushed
+  static void initBatch (Batch & batch, bool timed = true)
+  {
+    if (instrumentation.queue_wait && timed)
+      batch.pushtime = getTimeCounter();
+    if (instrumentation.trace && timeline)
+      batch.trace_id = link_keys.fetch_add(batch.size, std::memory_order_relaxed);
+    if (profile)
+      batch.profile_path = profile->currentPath();
+  }
+
+  // link start events for tasks first ... next-1, before they are pushed
+  static void traceSpawn (const Batch & batch, int first, int next)
+  {
+    if (!instrumentation.trace || !timeline) return;
+    size_t now = getTimeCounter();
+    for (int i = first; i < next; i++)
+      timeline->add(Event{now, batch.trace_id+i, 2});
+  }
+
+
+
+  /*
+    Idle threads spin, yield, and finally park on a condition variable.
+    Parking uses an event count: a sleeper registers, reads the epoch,
+    checks once more for work and sleeps only while the epoch is unchanged.
+    Whoever publishes work (or finishes a batch, or stops the workers)
+    bumps the epoch and notifies if anybody sleeps. With nobody parked a
+    wake-up costs one atomic increment and a load.
+  */
+  static IdleStrategy idle_strategy;
+  static std::atomic<uint64_t> epoch{0};
+  static std::atomic<int> sleepers{0};
+  static std::mutex park_mutex;
+  static std::condition_variable park_cv;
+
+  static inline void cpuRelax()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+
+  static bool haveWork()
+  {
+    if (thread_id >= 0 && mailboxes[thread_id].task.load(std::memory_order_relaxed))
+      return true;
+    if (num_injected.load(std::memory_order_relaxed))
+      return true;
+    for (auto & deque : deques)
+      if (!deque->empty()) return true;
+    return false;
+  }
+
+  static void wakeIdle()
+  {
+    if (idle_strategy.policy != IdlePolicy::SpinPark) return;
+    epoch.fetch_add(1);
+    if (sleepers.load() > 0)
+      {
+        // empty critical section: a sleeper between its check and wait holds the lock
+        { std::lock_guard<std::mutex> lock(park_mutex); }
+        park_cv.notify_all();
+      }
+  }
+
+  template <typename TDONE>
+  static void idleRound (int & rounds, TDONE done)
+  {
+    const IdleStrategy & s = idle_strategy;
+    rounds++;
+    if (s.policy == IdlePolicy::BusySpin)
+      return;
+    if (rounds <= s.spins)
+      {
+        cpuRelax();
+        return;
+      }
+    if (s.policy == IdlePolicy::SpinYield || rounds <= s.spins+s.yields)
+      {
+        std::this_thread::yield();
+        return;
+      }
+
+    sleepers.fetch_add(1);
+    uint64_t e = epoch.load();
+    if (!done() && !haveWork())
+      {
+        count(myCounters().parks);
+        std::unique_lock<std::mutex> lock(park_mutex);
+        park_cv.wait(lock, [e] { return epoch.load() != e; });
+      }
+    sleepers.fetch_sub(1);
+    rounds = 0;
+  }
+
+  // called when findTask came back empty, rounds counts the failures in a row.
+  // Idle time is the rounds plus the failed searches between them
+  template <typename TDONE>
+  static void idleWait (int & rounds, TDONE done)
+  {
+    static thread_local size_t last_round;
+    ThreadCounters & cnts = myCounters();
+    size_t t0 = getTimeCounter();
+    if (rounds > 0)
+      count(cnts.idle_ticks, t0-last_round);
+    idleRound(rounds, done);
+    last_round = getTimeCounter();
+    count(cnts.idle_ticks, last_round-t0);
+  }
+
+
+
+  static void runTask (Task * task)
+  {
+    Batch & batch = *task->batch;
+    int size = batch.size;
+
+    ThreadCounters & cnts = myCounters();
+    count(cnts.tasks);
+    if (batch.pushtime)
+      {
+        size_t now = getTimeCounter();
+        if (now > batch.pushtime)
+          count(cnts.queue_wait, now-batch.pushtime);
+      }
+
+    Profile * prof = profile.get();
+    if (prof)
+      prof->enterTask(batch.profile_path);
+    bool trace = instrumentation.trace && timeline;
+    if (trace)
+      {
+        timeline->add(Event{getTimeCounter(), batch.trace_id+task->nr, 3});
+        taskTimer().start();
+      }
+    batch.trampoline(batch.func, task->nr, size);
+    if (trace)
+      taskTimer().stop();
+    if (prof)
+      prof->leaveTask();
+
+    // the caller of RunParallel may be parked, the last one wakes it up.
+    // Don't touch the batch after the increment, it may be gone.
+    if (batch.cnt.fetch_add(1, std::memory_order_release) == size-1)
+      wakeIdle();
+  }
+
+  // to the own deque, or the injection queue for threads outside the pool
+  static void pushTasks (Task * tasks, int num)
+  {
+    if (thread_id >= 0)
+      {
+        deques[thread_id]->pushBulk(tasks, num);
+        return;
+      }
+    std::lock_guard<std::mutex> lock(injection_mutex);
+    for (int i = 0; i < num; i++)
+      injection.push_back(&tasks[i]);
+    num_injected.fetch_add(num, std::memory_order_relaxed);
+  }
+
+  static Task * popInjected ()
+  {
+    if (num_injected.load(std::memory_order_relaxed) == 0)
+      return nullptr;
+    std::lock_guard<std::mutex> lock(injection_mutex);
+    if (injection.empty())
+      return nullptr;
+    Task * task = injection.front();
+    injection.pop_front();
+    num_injected.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+  }
+
+  // mailbox, own deque, injected tasks, then steal from the others,
+  // starting at a random victim
+  static Task * findTask ()
+  {
+    if (thread_id >= 0)
+      {
+        std::atomic<Task*> & mail = mailboxes[thread_id].task;
+        if (mail.load(std::memory_order_relaxed))
+          return mail.exchange(nullptr, std::memory_order_acquire);
+
+        if (Task * task = deques[thread_id]->pop())
+          return task;
+      }
+
+    if (Task * task = popInjected())
+      return task;
+
+    static thread_local std::minstd_rand rng(thread_id+2);
+    size_t num = deques.size();
+    size_t first = rng() % num;
+    for (size_t i = 0; i < num; i++)
+      {
+        size_t victim = (first+i) % num;
+        if (victim == size_t(thread_id)) continue;
+        if (Task * task = deques[victim]->steal())
+          {
+            count(myCounters().steals);
+            return task;
+          }
+      }
+    count(myCounters().failed_dequeues);
+    return nullptr;
+  }
+
+
+
+  // cpu and NUMA node each thread is pinned to, -1 if not pinned
+  static std::vector<int> thread_cpu, thread_node;
+
+#ifdef __linux__
+  static cpu_set_t caller_cpuset;
+
+  struct CpuInfo
+  {
+    int cpu, node, package, core, smt;
+  };
+
+  // "0-3,8,10-11" -> 0,1,2,3,8,10,11
+  static std::vector<int> parseCpuList (const std::string & list)
+  {
+    std::vector<int> cpus;
+    std::stringstream str(list);
+    std::string item;
+    while (std::getline(str, item, ','))
+      {
+        if (item.empty()) continue;
+        int first, last;
+        char dash;
+        std::stringstream istr(item);
+        istr >> first;
+        last = (istr >> dash >> last) ? last : first;
+        for (int c = first; c <= last; c++)
+          cpus.push_back(c);
+      }
+    return cpus;
+  }
+
+  static std::string readSysFile (const std::string & name)
+  {
+    std::ifstream in(name);
+    std::string line;
+    std::getline(in, line);
+    return line;
+  }
+
+  // the cpus this process may run on, from sysfs
+  static std::vector<CpuInfo> cpuTopology()
+  {
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    std::vector<int> node_of(CPU_SETSIZE, 0);
+    for (int node : parseCpuList(readSysFile("/sys/devices/system/node/online")))
+      for (int c : parseCpuList(readSysFile("/sys/devices/system/node/node"+std::to_string(node)+"/cpulist")))
+        if (c < CPU_SETSIZE) node_of[c] = node;
+
+    std::vector<CpuInfo> cpus;
+    for (int c = 0; c < CPU_SETSIZE; c++)
+      if (CPU_ISSET(c, &allowed))
+        {
+          std::string dir = "/sys/devices/system/cpu/cpu"+std::to_string(c)+"/topology/";
+          std::string package = readSysFile(dir+"physical_package_id");
+          std::string core = readSysFile(dir+"core_id");
+          CpuInfo info { c, node_of[c], package.empty() ? 0 : std::stoi(package),
+                         core.empty() ? c : std::stoi(core), 0 };
+          // position among the hyperthreads of the same core
+          for (auto & other : cpus)
+            if (other.package == info.package && other.core == info.core)
+              info.smt++;
+          cpus.push_back(info);
+        }
+    return cpus;
+  }
+
+  // cpu for each of nthreads threads
+  static std::vector<int> placeThreads (const ThreadAffinity & affinity, int nthreads,
+                                        std::vector<CpuInfo> topo)
+  {
+    std::vector<int> cpus;
+    if (affinity.policy == AffinityPolicy::None)
+      return cpus;
+
+    if (affinity.policy == AffinityPolicy::Explicit)
+      {
+        if (affinity.cpus.empty()) return cpus;
+        for (int i = 0; i < nthreads; i++)
+          cpus.push_back(affinity.cpus[i % affinity.cpus.size()]);
+        return cpus;
+      }
+
+    if (topo.empty()) return cpus;
+    std::sort (topo.begin(), topo.end(), [] (const CpuInfo & a, const CpuInfo & b)
+    {
+      return std::tie(a.node, a.smt, a.package, a.core, a.cpu)
+        < std::tie(b.node, b.smt, b.package, b.core, b.cpu);
+    });
+
+    if (affinity.policy == AffinityPolicy::Compact)
+      {
+        for (int i = 0; i < nthreads; i++)
+          cpus.push_back(topo[i % topo.size()].cpu);
+        return cpus;
+      }
+
+    // Scatter: round-robin over the nodes, compact within a node
+    std::vector<std::vector<int>> bynode;
+    for (size_t i = 0; i < topo.size(); i++)
+      {
+        if (i == 0 || topo[i].node != topo[i-1].node)
+          bynode.emplace_back();
+        bynode.back().push_back(topo[i].cpu);
+      }
+    for (int i = 0; i < nthreads; i++)
+      {
+        auto & node = bynode[i % bynode.size()];
+        cpus.push_back(node[(i / bynode.size()) % node.size()]);
+      }
+    return cpus;
+  }
+
+  static int nodeOfCpu (int cpu, const std::vector<CpuInfo> & topo)
+  {
+    for (auto & info : topo)
+      if (info.cpu == cpu) return info.node;
+    return -1;
+  }
+
+  static void pinThread (int cpu)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+#endif
+
+
+  void StartWorkers(int num, IdleStrategy idle, ThreadAffinity affinity)
   {
     stop = false;
+    idle_strategy = idle;
+    thread_id = 0;
+    deques.clear();
+    for (int i = 0; i <= num; i++)
+      deques.push_back(std::make_unique<WorkStealingDeque>());
+    mailboxes.reset(new Mailbox[num+1]);
+    counters.reset(new ThreadCounters[num+1]);
+    start_ticks = getTimeCounter();
+    start_time = std::chrono::steady_clock::now();
+
+    thread_cpu.assign(num+1, -1);
+    thread_node.assign(num+1, -1);
+#ifdef __linux__
+    std::vector<CpuInfo> topo;
+    if (affinity.policy != AffinityPolicy::None)
+      topo = cpuTopology();
+    std::vector<int> cpus = placeThreads(affinity, num+1, topo);
+    if (!cpus.empty())
+      {
+        for (int i = 0; i <= num; i++)
+          {
+            thread_cpu[i] = cpus[i];
+            thread_node[i] = nodeOfCpu(cpus[i], topo);
+          }
+        pthread_getaffinity_np(pthread_self(), sizeof(caller_cpuset), &caller_cpuset);
+        pinThread(thread_cpu[0]);
+      }
+#endif
+
     for (int i = 0; i < num; i++)
       {
         TimeLine * patl = timeline.get();
+        Profile * pprof = profile.get();
         threads.push_back
-          (std::thread([patl]()
+          (std::thread([patl,pprof,i]()
           {
+            thread_id = i+1;
+#ifdef __linux__
+            if (thread_cpu[i+1] >= 0)
+              pinThread(thread_cpu[i+1]);
+#endif
             if (patl)
-              timeline = std::make_unique<TimeLine>();
-          
-            TPToken ptoken(queue); 
-            TCToken ctoken(queue); 
-            
+              timeline = std::make_unique<TimeLine>(*patl);
+            if (pprof)
+              profile = std::make_unique<Profile>(*pprof);
+
+            int rounds = 0;
             while(true)
               {
                 if (stop) break;
 
-                Task task;
-                if(!queue.try_dequeue_from_producer(ptoken, task)) 
-                  if(!queue.try_dequeue(ctoken, task))  
-                    continue; 
-                
-                (*task.pfunc)(task.nr, task.size);
-                (*task.cnt)++;
+                Task * task = findTask();
+                if (!task)
+                  {
+                    idleWait(rounds, [] { return stop.load(); });
+                    continue;
+                  }
+                rounds = 0;
+                runTask(task);
               }
-            
-            if (patl)
-              patl -> addTimeLine(std::move(*timeline));
+
+            timeline.reset();
+            profile.reset();
           }));
       }
   }
 
+  int NumThreads()
+  {
+    return deques.empty() ? 1 : deques.size();
+  }
+
+  int ThreadId()
+  {
+    return thread_id;
+  }
+
+  int NumaNode(int thread)
+  {
+    if (thread < 0 || thread >= int(thread_node.size())) return -1;
+    return thread_node[thread];
+  }
+
+  void SetTaskInstrumentation (TaskInstrumentation _instrumentation)
+  {
+    instrumentation = _instrumentation;
+  }
+
+  std::vector<TaskStatistics> GetTaskStatistics()
+  {
+    if (!counters)
+      return final_statistics;
+
+    double sec_per_tick =
+      std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time).count()
+      / std::max<double>(1, getTimeCounter()-start_ticks);
+
+    std::vector<TaskStatistics> stats(deques.size());
+    for (size_t i = 0; i < stats.size(); i++)
+      {
+        auto & c = counters[i];
+        stats[i].tasks = c.tasks.load(std::memory_order_relaxed);
+        stats[i].steals = c.steals.load(std::memory_order_relaxed);
+        stats[i].failed_dequeues = c.failed_dequeues.load(std::memory_order_relaxed);
+        stats[i].idle = sec_per_tick * c.idle_ticks.load(std::memory_order_relaxed);
+        stats[i].parks = c.parks.load(std::memory_order_relaxed);
+        stats[i].queue_wait = sec_per_tick * c.queue_wait.load(std::memory_order_relaxed);
+      }
+    return stats;
+  }
+
+  void PrintTaskStatistics (std::ostream & ost)
+  {
+    auto stats = GetTaskStatistics();
+    TaskStatistics sum;
+    ost << "thread       tasks      steals      failed  idle[ms]     parks  queue wait[ms]" << std::endl;
+    auto line = [&ost] (const std::string & name, const TaskStatistics & s)
+    {
+      ost << std::setw(6) << name
+          << std::setw(12) << s.tasks << std::setw(12) << s.steals
+          << std::setw(12) << s.failed_dequeues << std::setw(10) << 1e3*s.idle
+          << std::setw(10) << s.parks << std::setw(16) << 1e3*s.queue_wait << std::endl;
+    };
+    for (size_t i = 0; i < stats.size(); i++)
+      {
+        line (std::to_string(i), stats[i]);
+        sum.tasks += stats[i].tasks;
+        sum.steals += stats[i].steals;
+        sum.failed_dequeues += stats[i].failed_dequeues;
+        sum.idle += stats[i].idle;
+        sum.parks += stats[i].parks;
+        sum.queue_wait += stats[i].queue_wait;
+      }
+    line ("total", sum);
+  }
+
+  bool LocalQueueEmpty()
+  {
+    if (deques.empty()) return false;
+    if (thread_id < 0) return num_injected.load(std::memory_order_relaxed) == 0;
+    return deques[thread_id]->empty();
+  }
+
+
   void StopWorkers()
   {
     stop = true;
+    wakeIdle();
     for (auto & t : threads)
       t.join();
     threads.clear();
+    final_statistics = GetTaskStatistics();
+    counters.reset();
+    deques.clear();
+    mailboxes.reset();
+    thread_id = -1;
+
+#ifdef __linux__
+    if (!thread_cpu.empty() && thread_cpu[0] >= 0)
+      pthread_setaffinity_np(pthread_self(), sizeof(caller_cpuset), &caller_cpuset);
+#endif
+    thread_cpu.clear();
+    thread_node.clear();
+  }
+
+
+  // keep working while waiting: own (nested) tasks first, then steal
+  static void waitFor (const Batch & batch)
+  {
+    int rounds = 0;
+    while (batch.cnt.load(std::memory_order_acquire) < batch.size)
+      if (Task * task = findTask())
+        {
+          runTask(task);
+          rounds = 0;
+        }
+      else
+        idleWait(rounds, [&batch] { return batch.cnt.load() == batch.size; });
   }
 
-  
+
   void RunParallel (int num,
                     const std::function<void(int nr, int size)> & func)
   {
-    TPToken ptoken(queue);
-    TCToken ctoken(queue);
-    
-    std::atomic<int> cnt{0};
+    detail::runParallel (num, [] (const void * f, int nr, int size)
+    {
+      (*static_cast<const std::function<void(int,int)>*>(f))(nr, size);
+    }, &func);
+  }
 
 
-    for (size_t i = 0; i < num; i++)
+  void detail::runParallel (int num, TaskFunction trampoline, const void * func)
+  {
+    if (deques.empty())
+      {
+        for (int i = 0; i < num; i++)
+          trampoline(func, i, num);
+        return;
+      }
+
+    Batch batch;
+    batch.trampoline = trampoline;
+    batch.func = func;
+    batch.size = num;
+
+    // small batches (the common nested case) don't go to the heap
+    constexpr int NSMALL = 16;
+    Task small[NSMALL];
+    std::unique_ptr<Task[]> large;
+    Task * tasks = small;
+    if (num > NSMALL)
+      {
+        large.reset(new Task[num]);
+        tasks = large.get();
+      }
+    for (int i = 0; i < num; i++)
+      tasks[i] = Task{i, &batch};
+
+    initBatch(batch);
+    traceSpawn(batch, 0, num);
+    // the owner pops 0,1,2,... and thieves take from the end
+    pushTasks(tasks, num);
+    wakeIdle();
+    waitFor(batch);
+  }
+
+
+
+  // task nr for thread nr = 0 ... num-1, via the mailboxes
+  static void runOnThreads (int num, detail::TaskFunction trampoline, const void * func)
+  {
+    // thread 0 would have to pick up its task while we wait, which it
+    // may never do. Running the parts as tasks instead could put two
+    // members of a team on one thread and deadlock at the barrier
+    if (thread_id < 0)
       {
-        Task task;
-        task.nr = i;
-        task.size = num;
-        task.pfunc = &func;
-        task.cnt = &cnt;
-        queue.enqueue(ptoken, task);
-      }
-
-    /*
-    // faster with bulk enqueue (error with gcc-Release)
-    Task firsttask;
-    firsttask.nr = 0;
-    firsttask.size = num;
-    firsttask.pfunc=&func;
-    firsttask.cnt = &cnt;
-    queue.enqueue_bulk (ptoken, firsttask, num);    
-    */
-    
-    while (cnt < num)
-      {
-        Task task;
-        if(!queue.try_dequeue_from_producer(ptoken, task)) 
-          if(!queue.try_dequeue(ctoken, task))
-            continue; 
-        
-        (*task.pfunc)(task.nr, task.size);
-        (*task.cnt)++;
+        std::cerr << "RunOnEachThread/ParallelRegion called from a thread outside the pool"
+                  << std::endl;
+        std::abort();
       }
+    Batch batch;
+    batch.trampoline = trampoline;
+    batch.func = func;
+    batch.size = num;
+
+    initBatch(batch);
+    traceSpawn(batch, 0, num);
+    std::vector<Task> tasks(num);
+    for (int i = 0; i < num; i++)
+      {
+        tasks[i] = Task{i, &batch};
+        if (i != thread_id)
+          mailboxes[i].task.store(&tasks[i], std::memory_order_release);
+      }
+    wakeIdle();
+    if (thread_id < num)
+      runTask(&tasks[thread_id]);
+    waitFor(batch);
+  }
+
+  void detail::runOnEachThread (TaskFunction trampoline, const void * func)
+  {
+    if (deques.empty())
+      trampoline(func, 0, 1);
+    else
+      runOnThreads(deques.size(), trampoline, func);
+  }
+
+
+
+  // centralized sense-reversing barrier
+  class detail::TeamBarrier
+  {
+    alignas(64) std::atomic<int> count;
+    alignas(64) std::atomic<bool> sense{false};
+    int size;
+  public:
+    TeamBarrier (int _size) : count(_size), size(_size) { }
+
+    void wait (bool & local_sense)
+    {
+      local_sense = !local_sense;
+      if (count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+          // the last one resets the count and releases the others
+          count.store(size, std::memory_order_relaxed);
+          sense.store(local_sense, std::memory_order_release);
+          return;
+        }
+
+      // members may share cores, so give the cpu away after a while
+      for (int rounds = 0; sense.load(std::memory_order_acquire) != local_sense; rounds++)
+        if (rounds < idle_strategy.spins || idle_strategy.policy == IdlePolicy::BusySpin)
+          cpuRelax();
+        else
+          std::this_thread::yield();
+    }
+  };
+
+  void Team::barrier()
+  {
+    m_barrier->wait(m_sense);
+  }
+
+  void detail::parallelRegion (int nthreads, TeamFunction trampoline, const void * func)
+  {
+    if (nthreads <= 0 || nthreads > NumThreads())
+      nthreads = NumThreads();
+
+    TeamBarrier barrier(nthreads);
+    if (deques.empty())
+      {
+        Team team(0, 1, &barrier);
+        trampoline(func, team);
+        return;
+      }
+
+    struct Region
+    {
+      TeamFunction trampoline;
+      const void * func;
+      TeamBarrier * barrier;
+    } region { trampoline, func, &barrier };
+
+    runOnThreads (nthreads, [] (const void * r, int nr, int size)
+    {
+      auto & region = *static_cast<const Region*>(r);
+      Team team(nr, size, region.barrier);
+      region.trampoline(region.func, team);
+    }, &region);
+  }
+
+
+  class detail::AsyncBatch
+  {
+  public:
+    Batch batch;
+    std::unique_ptr<Task[]> tasks;
+    std::shared_ptr<void> keepalive;
+  };
+
+  detail::AsyncBatch * detail::runParallelAsync (int num, TaskFunction trampoline, const void * func,
+                                                 std::shared_ptr<void> keepalive)
+  {
+    auto async = new AsyncBatch;
+    async->keepalive = std::move(keepalive);
+    Batch & batch = async->batch;
+    batch.trampoline = trampoline;
+    batch.func = func;
+    batch.size = num;
+
+    if (deques.empty())
+      {
+        for (int i = 0; i < num; i++)
+          trampoline(func, i, num);
+        batch.cnt = num;
+        return async;
+      }
+
+    async->tasks.reset(new Task[num]);
+    for (int i = 0; i < num; i++)
+      async->tasks[i] = Task{i, &batch};
+    initBatch(batch);
+    traceSpawn(batch, 0, num);
+    pushTasks(async->tasks.get(), num);
+    wakeIdle();
+    return async;
+  }
+
+  bool TaskHandle::test() const
+  {
+    return !batch || batch->batch.cnt.load(std::memory_order_acquire) == batch->batch.size;
+  }
+
+  void TaskHandle::wait()
+  {
+    if (!batch) return;
+    waitFor(batch->batch);
+    delete batch;
+    batch = nullptr;
+  }
+
+
+
+  // state of one TaskGraph::run
+  struct GraphRun
+  {
+    const TaskGraph * graph;
+    std::unique_ptr<std::atomic<int>[]> pending;   // unfinished predecessors
+    std::unique_ptr<Task[]> tasks;
+  };
+
+  TaskGraph::Handle TaskGraph::add (std::function<void()> func,
+                                    const std::vector<Handle> & predecessors)
+  {
+    int nr = nodes.size();
+    for (auto pred : predecessors)
+      if (pred.graph != this || pred.nr < 0 || pred.nr >= nr)
+        {
+          std::cerr << "TaskGraph::add: predecessor is not a task of this graph" << std::endl;
+          std::abort();
+        }
+    nodes.push_back (Node{std::move(func), {}, int(predecessors.size())});
+    for (auto pred : predecessors)
+      nodes[pred.index()].successors.push_back(nr);
+    return Handle(this, nr);
+  }
+
+  void TaskGraph::runNode (const void * graphrun, int nr, int size)
+  {
+    auto & run = *static_cast<const GraphRun*>(graphrun);
+    const Node & node = run.graph->nodes[nr];
+    node.func();
+
+    // the last predecessor to finish pushes the successor to its own deque,
+    // or injects it if it runs outside the pool
+    bool pushed = false;
+    for (int succ : node.successors)
+      if (run.pending[succ].fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+          traceSpawn(*run.tasks[succ].batch, succ, succ+1);
+          pushTasks(&run.tasks[succ], 1);
+          pushed = true;
+        }
+    if (pushed)
+      wakeIdle();
+  }
+
+  void TaskGraph::run()
+  {
+    int num = nodes.size();
+
+    if (deques.empty())
+      {
+        std::vector<int> pending(num), ready;
+        for (int i = num-1; i >= 0; i--)
+          if ((pending[i] = nodes[i].num_predecessors) == 0)
+            ready.push_back(i);
+        while (!ready.empty())
+          {
+            int nr = ready.back();
+            ready.pop_back();
+            nodes[nr].func();
+            for (int succ : nodes[nr].successors)
+              if (--pending[succ] == 0)
+                ready.push_back(succ);
+          }
+        return;
+      }
+
+    GraphRun graphrun { this, std::make_unique<std::atomic<int>[]>(num),
+                        std::make_unique<Task[]>(num) };
+    Batch batch;
+    batch.trampoline = runNode;
+    batch.func = &graphrun;
+    batch.size = num;
+
+    // all counters are set before the first task can run
+    for (int i = 0; i < num; i++)
+      {
+        graphrun.pending[i].store(nodes[i].num_predecessors, std::memory_order_relaxed);
+        graphrun.tasks[i] = Task{i, &batch};
+      }
+
+    // no queue wait, successors are pushed long after the batch started
+    initBatch(batch, false);
+
+    // in reverse, so the owner pops the roots in order
+    for (int i = num-1; i >= 0; i--)
+      if (nodes[i].num_predecessors == 0)
+        {
+          traceSpawn(batch, i, i+1);
+          pushTasks(&graphrun.tasks[i], 1);
+        }
+    wakeIdle();
+    waitFor(batch);
   }
 }
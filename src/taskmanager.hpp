@@ -2,16 +2,426 @@
 #define TASKMANAGER_H
 
 #include<functional>
+#include <iosfwd>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 
 namespace ASC_HPC
 {
+
+  // the half-open index range [first, next)
+  template <typename T = size_t>
+  class T_Range
+  {
+    T m_first, m_next;
+  public:
+    T_Range (T n) : m_first(0), m_next(n) { }
+    T_Range (T first, T next) : m_first(first), m_next(next) { }
+
+    T first() const { return m_first; }
+    T next() const { return m_next; }
+    size_t size() const { return m_next - m_first; }
+    bool empty() const { return m_next <= m_first; }
+
+    // part nr of num nearly equal parts
+    T_Range split (size_t nr, size_t num) const
+    {
+      size_t n = size();
+      return T_Range (m_first + T(n*nr/num), m_first + T(n*(nr+1)/num));
+    }
+
+    class iterator
+    {
+      T i;
+    public:
+      iterator (T _i) : i(_i) { }
+      T operator* () const { return i; }
+      iterator & operator++ () { ++i; return *this; }
+      bool operator!= (iterator other) const { return i != other.i; }
+    };
+    iterator begin() const { return m_first; }
+    iterator end() const { return m_next; }
+  };
+
   
-  void StartWorkers(int num);
+  // what a thread does when it finds no task to run
+  enum class IdlePolicy
+  {
+    BusySpin,    // spin on the queues, lowest latency, keeps every core at 100%
+    SpinYield,   // spin with cpu pause, then keep yielding the time slice
+    SpinPark     // spin, yield, then sleep until new tasks arrive
+  };
+
+  struct IdleStrategy
+  {
+    IdlePolicy policy = IdlePolicy::SpinPark;
+    int spins = 1000;    // rounds with cpu pause
+    int yields = 100;    // then rounds with std::this_thread::yield
+  };
+
+  /*
+    pinning of threads to cpus (Linux, elsewhere ignored).
+    Thread 0 is the caller of StartWorkers, threads 1..num the workers.
+    Compact fills one NUMA node after the other, physical cores before
+    their hyperthread siblings. Scatter deals threads round-robin to
+    the nodes. Explicit takes cpus[i % cpus.size()] for thread i.
+    Only cpus in the process' affinity mask are used.
+  */
+  enum class AffinityPolicy { None, Compact, Scatter, Explicit };
+
+  struct ThreadAffinity
+  {
+    AffinityPolicy policy = AffinityPolicy::None;
+    std::vector<int> cpus;
+  };
+
+  void StartWorkers(int num, IdleStrategy idle = IdleStrategy(),
+                    ThreadAffinity affinity = ThreadAffinity());
   void StopWorkers();
+
+  // 0 for the caller of StartWorkers, 1..num for the workers,
+  // -1 for all other threads
+  int ThreadId();
+
+  // NUMA node thread nr is pinned to, -1 if not pinned or unknown
+  int NumaNode(int thread);
+
+  // workers plus the calling thread, 1 if no workers are running
+  int NumThreads();
+
+  // the calling thread's deque is empty, nothing of ours is left to steal
+  bool LocalQueueEmpty();
+
+
+  // scheduler counters of one thread
+  struct TaskStatistics
+  {
+    size_t tasks = 0;            // tasks run
+    size_t steals = 0;           // of those, taken from other threads
+    size_t failed_dequeues = 0;  // searches for a task which found none
+    size_t parks = 0;            // times the thread went to sleep
+    double idle = 0;             // seconds spent spinning, yielding, parked or searching in vain
+    double queue_wait = 0;       // seconds from spawn to start, summed over tasks
+  };
+
+  struct TaskInstrumentation
+  {
+    // measure queue_wait, costs a time stamp per task
+    bool queue_wait = false;
+    // every task as state "task" in the TimeLine of its thread, with a
+    // fork link from the spawning thread (threads with a TimeLine only)
+    bool trace = false;
+  };
+
+  void SetTaskInstrumentation (TaskInstrumentation instrumentation);
+
+  // indexed by ThreadId(). While the workers run a snapshot,
+  // after StopWorkers the final counts of the last run
+  std::vector<TaskStatistics> GetTaskStatistics();
+  void PrintTaskStatistics (std::ostream & ost);
   
+  /*
+    runs func(nr, num) for nr = 0 ... num-1 and returns when all are done.
+    Any thread may call it. The caller of StartWorkers and the workers
+    push to their own deque, other threads (ThreadId() == -1) to a
+    shared, locked injection queue which every idle thread polls.
+  */
   void RunParallel (int num,
                     const std::function<void(int nr, int size)> & func);
+
+  namespace detail
+  {
+    // calls (*func)(nr, size), one instantiation per lambda type
+    using TaskFunction = void (*) (const void * func, int nr, int size);
+    void runParallel (int num, TaskFunction trampoline, const void * func);
+  }
+
+  // keeps the type of func, the task body is called through one
+  // trampoline per batch and may be inlined into it
+  template <typename F>
+  void RunParallel (int num, F && func)
+  {
+    using TF = std::remove_reference_t<F>;
+    detail::runParallel (num, [] (const void * f, int nr, int size)
+    {
+      (*static_cast<const TF*>(f))(nr, size);
+    }, &func);
+  }
+
+
+  namespace detail
+  {
+    void runOnEachThread (TaskFunction trampoline, const void * func);
+  }
+
+  /*
+    func(thread, NumThreads()) runs exactly once on every thread, i.e.
+    with a fixed thread-to-work mapping as needed for first-touch
+    placement. Threads busy with long tasks delay it.
+    Call it from the thread which started the workers, threads outside
+    the pool (ThreadId() == -1) abort the program.
+  */
+  template <typename F>
+  void RunOnEachThread (F && func)
+  {
+    using TF = std::remove_reference_t<F>;
+    detail::runOnEachThread ([] (const void * f, int nr, int size)
+    {
+      (*static_cast<const TF*>(f))(nr, size);
+    }, &func);
+  }
+
+  /*
+    data[i] = value, part k of NumThreads() equal parts written by thread k.
+    Memory pages are placed on the NUMA node of the first writer, so
+    allocate uninitialized (e.g. AlignedAllocator<T>().allocate(n)) and
+    split later work the same way (T_Range(n).split(ThreadId(), NumThreads())
+    in RunOnEachThread) to keep it local.
+  */
+  template <typename T>
+  void ParallelFirstTouch (T * data, size_t n, const T & value = T())
+  {
+    RunOnEachThread ([data, n, &value] (int thread, int nthreads)
+    {
+      for (size_t i : T_Range<size_t>(n).split(thread, nthreads))
+        data[i] = value;
+    });
+  }
+
+
+  namespace detail
+  {
+    class TeamBarrier;
+  }
+
+  // the threads of a ParallelRegion, ranks are the thread ids 0 ... size-1
+  class Team
+  {
+    int m_rank, m_size;
+    detail::TeamBarrier * m_barrier;
+    bool m_sense = false;
+  public:
+    Team (int rank, int size, detail::TeamBarrier * barrier)
+      : m_rank(rank), m_size(size), m_barrier(barrier) { }
+
+    int rank() const { return m_rank; }
+    int size() const { return m_size; }
+
+    // this thread's static share of r
+    template <typename T>
+    T_Range<T> part (T_Range<T> r) const { return r.split(m_rank, m_size); }
+    T_Range<size_t> part (size_t n) const { return T_Range<size_t>(n).split(m_rank, m_size); }
+
+    // returns when all members of the team arrived
+    void barrier();
+  };
+
+  namespace detail
+  {
+    using TeamFunction = void (*) (const void * func, Team & team);
+    void parallelRegion (int nthreads, TeamFunction trampoline, const void * func);
+  }
+
+  /*
+    func(team) runs on nthreads threads at the same time, which stay
+    inside for the whole region and synchronize with team.barrier().
+    Repeated small parallel steps cost a barrier instead of a
+    RunParallel each, static parts make results reproducible.
+    nthreads <= 0 means all threads. Don't nest regions, and call it
+    from the thread which started the workers, like RunOnEachThread.
+
+      ParallelRegion (0, [&] (Team & team)
+      {
+        for (int step = 0; step < nsteps; step++)
+          {
+            for (size_t i : team.part(n)) ...
+            team.barrier();
+          }
+      });
+  */
+  template <typename F>
+  void ParallelRegion (int nthreads, F && func)
+  {
+    using TF = std::remove_reference_t<F>;
+    detail::parallelRegion (nthreads, [] (const void * f, Team & team)
+    {
+      (*static_cast<const TF*>(f))(team);
+    }, &func);
+  }
+
+
+  namespace detail
+  {
+    class AsyncBatch;
+    // keepalive owns *func until the batch is released
+    AsyncBatch * runParallelAsync (int num, TaskFunction trampoline, const void * func,
+                                   std::shared_ptr<void> keepalive);
+  }
+
+  /*
+    handle to tasks started by RunParallelAsync.
+    wait() runs pending tasks (ours first) until all of them are done,
+    the destructor waits as well. Wait before StopWorkers.
+  */
+  class TaskHandle
+  {
+    detail::AsyncBatch * batch = nullptr;
+  public:
+    TaskHandle () = default;
+    explicit TaskHandle (detail::AsyncBatch * _batch) : batch(_batch) { }
+    TaskHandle (TaskHandle && other) : batch(std::exchange(other.batch, nullptr)) { }
+    TaskHandle & operator= (TaskHandle && other)
+    {
+      wait();
+      batch = std::exchange(other.batch, nullptr);
+      return *this;
+    }
+    ~TaskHandle() { wait(); }
+
+    // all tasks are done, doesn't block
+    bool test() const;
+    void wait();
+  };
+
+  // like RunParallel, but returns at once. func is moved (or copied)
+  // into the handle, whatever it captures by reference must outlive the tasks
+  template <typename F>
+  TaskHandle RunParallelAsync (int num, F && func)
+  {
+    using TF = std::decay_t<F>;
+    auto pfunc = std::make_shared<TF> (std::forward<F>(func));
+    const TF * pf = pfunc.get();
+    return TaskHandle (detail::runParallelAsync (num, [] (const void * f, int nr, int size)
+    {
+      (*static_cast<const TF*>(f))(nr, size);
+    }, pf, std::move(pfunc)));
+  }
+
+
+  namespace detail
+  {
+    // lazy binary splitting: work through r grain by grain, and whenever
+    // nothing of ours is left to steal, hand out the upper half of the rest
+    template <typename T, typename F>
+    void parallelForChunk (T_Range<T> r, const F & func, size_t grainsize)
+    {
+      while (r.size() > grainsize)
+        {
+          if (LocalQueueEmpty())
+            {
+              T mid = r.first() + T(r.size()/2);
+              RunParallel (2, [&] (int i, int size)
+              {
+                if (i == 0)
+                  parallelForChunk (T_Range<T>(r.first(), mid), func, grainsize);
+                else
+                  parallelForChunk (T_Range<T>(mid, r.next()), func, grainsize);
+              });
+              return;
+            }
+          T next = r.first() + T(grainsize);
+          func (T_Range<T>(r.first(), next));
+          r = T_Range<T>(next, r.next());
+        }
+      if (!r.empty())
+        func (r);
+    }
+  }
+
+  /*
+    func(T_Range<T> sub) is called for disjoint sub-ranges covering r.
+    One chunk per thread is submitted at once, the chunks are split
+    further on demand, but not below grainsize.
+    grainsize = 0 picks one 16th of a chunk.
+  */
+  template <typename T, typename F>
+  void ParallelFor (T_Range<T> r, const F & func, size_t grainsize = 0)
+  {
+    size_t nthreads = NumThreads();
+    if (grainsize == 0)
+      grainsize = std::max<size_t> (1, r.size() / (16*nthreads));
+    size_t num = std::min (nthreads, (r.size()+grainsize-1) / grainsize);
+    if (num <= 1)
+      {
+        if (!r.empty()) func (r);
+        return;
+      }
+
+    RunParallel (num, [&] (int i, int size)
+    {
+      detail::parallelForChunk (r.split(i, size), func, grainsize);
+    });
+  }
+
+  template <typename F>
+  void ParallelFor (size_t n, const F & func, size_t grainsize = 0)
+  {
+    ParallelFor (T_Range<size_t>(n), func, grainsize);
+  }
+
+
+
+  /*
+    tasks with dependencies, built once and run many times:
+
+      TaskGraph g;
+      auto a = g.add (fa);
+      auto b = g.add (fb);
+      auto c = g.add (fc, { a, b });   // after a and b
+      auto d = c.then (fd);            // after c
+      for (int step = 0; step < 100; step++)
+        g.run();
+
+    run() starts all tasks without predecessors on the workers, a task
+    becomes ready when its last predecessor finished. The caller helps
+    until all tasks are done. A task may call RunParallel itself.
+  */
+  class TaskGraph
+  {
+    struct Node
+    {
+      std::function<void()> func;
+      std::vector<int> successors;
+      int num_predecessors = 0;
+    };
+    std::vector<Node> nodes;
+
+    static void runNode (const void * graphrun, int nr, int size);
+
+  public:
+    class Handle
+    {
+      TaskGraph * graph;
+      int nr;
+      friend TaskGraph;
+    public:
+      Handle (TaskGraph * _graph, int _nr) : graph(_graph), nr(_nr) { }
+      int index() const { return nr; }
+
+      // a new task running after this one
+      Handle then (std::function<void()> func) const
+      {
+        return graph->add (std::move(func), { *this });
+      }
+    };
+
+    // handles point into the graph, so it can't be copied or moved
+    TaskGraph () = default;
+    TaskGraph (const TaskGraph &) = delete;
+    TaskGraph & operator= (const TaskGraph &) = delete;
+
+    // predecessors must be handles of this graph, which keeps it acyclic.
+    // Others abort the program
+    Handle add (std::function<void()> func, const std::vector<Handle> & predecessors = {});
+
+    size_t size() const { return nodes.size(); }
+    void run();
+  };
   
 }
 
@@ -1,4 +1,22 @@
 #include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#if (defined(__amd64__) || defined(_M_AMD64)) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
 
 #include "timer.hpp"
 #include "taskmanager.hpp"
@@ -7,44 +25,358 @@
 namespace ASC_HPC
 {
   thread_local std::unique_ptr<TimeLine> timeline;
-  std::mutex TimeLine::timeline_mutex;
+  thread_local std::unique_ptr<Profile> profile;
   std::mutex Timer::m;
   std::vector<std::string> Timer::names;
   std::vector<std::array<float,3>> Timer::cols;      
   // int Timer::cnt = 0;
 
 
-  TimeLine :: TimeLine(std::string _filename)
-    : filename(_filename)
+  /*
+    binary trace file:
+      "ASCTRC02"
+      chunks of one thread's events:
+        varint thread, varint count, varint bytes,
+        per event varint zigzag(when - previous when of the thread),
+                  varint (timer << 3 | what)
+      trailer:
+        varint start, double seconds per tick, varint threads, varint dropped,
+        varint timers, per timer varint length, name, float[3] color
+      uint64 offset of the trailer
+  */
+  namespace
+  {
+    constexpr char traceMagic[] = "ASCTRC02";
+
+    void putVarint (std::string & buf, uint64_t val)
+    {
+      while (val >= 0x80)
+        {
+          buf += char(val | 0x80);
+          val >>= 7;
+        }
+      buf += char(val);
+    }
+
+    uint64_t getVarint (const char *& p, const char * end)
+    {
+      uint64_t val = 0;
+      for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+          uint8_t byte = *p++;
+          val |= uint64_t(byte & 0x7f) << shift;
+          if (!(byte & 0x80)) break;
+        }
+      return val;
+    }
+
+    template <typename T>
+    void putRaw (std::string & buf, T val)
+    {
+      buf.append (reinterpret_cast<const char*>(&val), sizeof(T));
+    }
+
+    template <typename T>
+    T getRaw (const char *& p)
+    {
+      T val;
+      memcpy (&val, p, sizeof(T));
+      p += sizeof(T);
+      return val;
+    }
+  }
+
+
+
+  EventRing :: EventRing (size_t capacity, TraceOverflow _overflow)
+    : overflow(_overflow)
+  {
+    size_t size = 2;
+    while (size < capacity) size *= 2;
+    slots.reset(new Slot[size]);
+    mask = size-1;
+  }
+
+  size_t EventRing :: drain (std::vector<Event> & out, size_t max, bool & lost)
+  {
+    size_t t0 = tail.load(std::memory_order_acquire);
+    size_t h = head.load(std::memory_order_acquire);
+    // the owner moved the tail past events we had not drained
+    lost = (t0 != drained);
+    drained = t0;
+    size_t n = std::min(h-t0, max);
+    if (n == 0) return 0;
+
+    size_t first = out.size();
+    for (size_t i = t0; i < t0+n; i++)
+      {
+        Slot & slot = slots[i & mask];
+        uint64_t tw = slot.timer_what.load(std::memory_order_relaxed);
+        out.push_back(Event{ slot.when.load(std::memory_order_relaxed),
+                             int(uint32_t(tw >> 32)), int(uint32_t(tw)) });
+      }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // the owner may have dropped the oldest of them meanwhile,
+    // then their slots may hold newer events
+    size_t t = t0;
+    while (!tail.compare_exchange_weak(t, t0+n, std::memory_order_acq_rel))
+      if (t >= t0+n)
+        {
+          out.resize(first);
+          lost = true;
+          drained = t;
+          return n;
+        }
+    out.erase(out.begin()+first, out.begin()+first+(t-t0));
+    if (t > t0)
+      lost = true;
+    drained = t0+n;
+    return n;
+  }
+
+
+
+  TimeLine :: TimeLine(std::string _filename, TraceOptions _options)
+    : filename(_filename), options(_options), root(this)
   {
-    events.reserve(1000*1000);
     start = getTimeCounter();
     start_time = std::chrono::high_resolution_clock::now();
+    ring = std::make_shared<EventRing>(options.capacity, options.overflow);
+    rings.push_back(ring);
+
+    if (filename != "")
+      {
+        spool.open(filename+".events", std::ios::binary);
+        spool.write(traceMagic, 8);
+        writer = std::thread([this] ()
+        {
+          while (true)
+            {
+              bool stop;
+              {
+                std::unique_lock<std::mutex> lock(writer_mutex);
+                writer_cv.wait_for(lock, std::chrono::milliseconds(options.flush_interval_ms),
+                                   [this] { return stop_writer; });
+                stop = stop_writer;
+              }
+              writeEvents();
+              if (stop) break;
+            }
+        });
+      }
+  }
+
+  TimeLine :: TimeLine(TimeLine & _root)
+    : start(_root.start), start_time(_root.start_time),
+      options(_root.options), root(&_root)
+  {
+    ring = std::make_shared<EventRing>(options.capacity, options.overflow);
+    root->registerRing(ring);
+  }
+
+  void TimeLine :: registerRing (std::shared_ptr<EventRing> _ring)
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    rings.push_back(_ring);
+  }
+
+  // at most one buffer per thread and round
+  void TimeLine :: writeEvents ()
+  {
+    std::vector<std::shared_ptr<EventRing>> current;
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex);
+      current = rings;
+    }
+    last_when.resize(current.size(), start);
+
+    constexpr size_t CHUNK = 4096;
+    std::vector<Event> chunk;
+    std::string head, buf;
+    for (uint32_t i = 0; i < current.size(); i++)
+      for (size_t total = 0; total < options.capacity; )
+        {
+          chunk.clear();
+          bool lost;
+          size_t n = current[i]->drain(chunk, CHUNK, lost);
+          // regions open at the gap may have lost their stop events
+          if (lost)
+            chunk.insert(chunk.begin(), Event{ last_when[i], 0, 4 });
+          if (!chunk.empty())
+            {
+              buf.clear();
+              for (auto & e : chunk)
+                {
+                  int64_t delta = int64_t(e.when - last_when[i]);
+                  last_when[i] = e.when;
+                  putVarint (buf, (uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+                  putVarint (buf, (uint64_t(uint32_t(e.timer)) << 3) | uint32_t(e.what));
+                }
+              head.clear();
+              putVarint (head, i);
+              putVarint (head, chunk.size());
+              putVarint (head, buf.size());
+              spool.write(head.data(), head.size());
+              spool.write(buf.data(), buf.size());
+            }
+          total += n;
+          if (n < CHUNK) break;
+        }
+    spool.flush();
   }
   
   TimeLine :: ~TimeLine()
   {
-    if (filename != "")
-      {
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto end = getTimeCounter();
-        auto duration = end_time-start_time;
-        
-        std::cout << "total time = "
-                  << std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
-                  << " microsec" << std::endl;
+    if (root != this || filename == "")
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex);
+      stop_writer = true;
+    }
+    writer_cv.notify_one();
+    writer.join();
 
-        double fac = 1e-3*double(std::chrono::duration_cast<std::chrono::microseconds>(duration).count()) / double(end-start);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto end = getTimeCounter();
+    auto duration = end_time-start_time;
         
+    std::cout << "total time = "
+              << std::chrono::duration_cast<std::chrono::microseconds>(duration).count()
+              << " microsec" << std::endl;
+
+    size_t dropped = 0;
+    for (auto & r : rings)
+      dropped += r->numDropped();
+    if (dropped)
+      std::cout << "timeline buffers were full, dropped " << dropped << " events" << std::endl;
+
+    std::string trailer;
+    uint64_t offset = spool.tellp();
+    putVarint (trailer, start);
+    putRaw (trailer, std::chrono::duration<double>(duration).count() / double(end-start));
+    putVarint (trailer, rings.size());
+    putVarint (trailer, dropped);
+    {
+      std::lock_guard<std::mutex> lock(Timer::m);
+      putVarint (trailer, Timer::names.size());
+      for (size_t i = 0; i < Timer::names.size(); i++)
+        {
+          putVarint (trailer, Timer::names[i].size());
+          trailer += Timer::names[i];
+          for (float c : Timer::cols[i])
+            putRaw (trailer, c);
+        }
+    }
+    putRaw (trailer, offset);
+    spool.write(trailer.data(), trailer.size());
+    spool.close();
+
+    std::string spoolname = filename+".events";
+    switch (options.format)
+      {
+      case TraceFormat::Binary:
+        std::cout << "write binary trace '" << filename << "'" << std::endl;
+        std::remove (filename.c_str());
+        std::rename (spoolname.c_str(), filename.c_str());
+        return;
+      case TraceFormat::Paje:
         std::cout << "write pajefile '" << filename << "'" << std::endl;
+        break;
+      case TraceFormat::Chrome:
+        std::cout << "write chrome trace '" << filename << "'" << std::endl;
+        break;
+      }
+    ConvertTrace (spoolname, filename, options.format);
+    std::remove (spoolname.c_str());
+  }
+
+
 
-        /*
-          documentation of paje-format:
-          https://paje.sourceforge.net/download/publication/lang-paje.pdf
-         */
+  namespace
+  {
+    class TraceFile
+    {
+      std::string data;
+      size_t events_end = 0;
+    public:
+      size_t start = 0;
+      double seconds_per_tick = 0;
+      size_t num_threads = 0;
+      size_t dropped = 0;
+      std::vector<std::string> names;
+      std::vector<std::array<float,3>> cols;
+
+      bool read (const std::string & filename)
+      {
+        std::ifstream file(filename, std::ios::binary);
+        data.assign (std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (data.size() < 16 || data.compare(0, 8, traceMagic) != 0)
+          return false;
+
+        const char * end = data.data()+data.size()-8;
+        const char * p = end;
+        events_end = getRaw<uint64_t>(p);
+        if (events_end < 8 || events_end > data.size()-8)
+          return false;
+
+        p = data.data()+events_end;
+        start = getVarint(p, end);
+        seconds_per_tick = getRaw<double>(p);
+        num_threads = getVarint(p, end);
+        dropped = getVarint(p, end);
+        size_t num_timers = getVarint(p, end);
+        for (size_t i = 0; i < num_timers && p < end; i++)
+          {
+            size_t len = std::min<size_t> (getVarint(p, end), end-p);
+            names.emplace_back(p, len);
+            p += len;
+            std::array<float,3> col;
+            for (float & c : col)
+              c = getRaw<float>(p);
+            cols.push_back(col);
+          }
+        return p <= end && names.size() == num_timers;
+      }
+
+      // func(thread, event), the events of each thread in order
+      template <typename F>
+      void forEachEvent (F func) const
+      {
+        std::vector<size_t> when(num_threads, start);
+        const char * p = data.data()+8;
+        const char * end = data.data()+events_end;
+        while (p < end)
+          {
+            size_t thread = getVarint(p, end);
+            size_t count = getVarint(p, end);
+            size_t bytes = getVarint(p, end);
+            if (thread >= num_threads)
+              {
+                p += bytes;
+                continue;
+              }
+            for (size_t j = 0; j < count && p < end; j++)
+              {
+                uint64_t zz = getVarint(p, end);
+                when[thread] += size_t((zz >> 1) ^ (~(zz & 1) + 1));
+                uint64_t tw = getVarint(p, end);
+                func (int(thread), Event{ when[thread], int(uint32_t(tw >> 3)), int(tw & 7) });
+              }
+          }
+      }
+    };
+
+
+    void writePaje (const TraceFile & trace, std::ostream & file)
+    {
+      /*
+        documentation of paje-format:
+        https://paje.sourceforge.net/download/publication/lang-paje.pdf
+      */
         
-        std::ofstream file(filename);
-        file << R"(
+      file << R"(
 %EventDef PajeDefineContainerType 0 
 %       Alias string 
 %       Type string 
@@ -160,39 +492,619 @@ namespace ASC_HPC
 0	main	0	"Task Manager"
 0	thds	main	"Thread"
 2	thdstate 	thds	"Task"
+4	fork	main	thds	thds	"Fork"
 6	0	a9	main	0	"Paje"
 )";
 
-        for (int i = 0; i <= subtl.size(); i++)
-          file << "6 0 th" << i << " thds a9 \"Thread " << i << "\"" << std::endl;
+      for (size_t i = 0; i < trace.num_threads; i++)
+        file << "6 0 th" << i << " thds a9 \"Thread " << i << "\"\n";
 
-        for (size_t i = 0; i < Timer::names.size(); i++)
+      for (size_t i = 0; i < trace.names.size(); i++)
+        {
+          auto col = trace.cols[i];
+          file << "5 timer" << i << " thdstate \"" << trace.names[i] << "\"  \"" << col[0] << " " << col[1] << " " << col[2] << "\"\n";
+        }
+
+      // in ms. Dropped events leave pops without push, which are skipped,
+      // and pushes without pop, which are closed at the gap or at the end
+      double fac = 1e3 * trace.seconds_per_tick;
+      std::vector<int> depth(trace.num_threads, 0);
+      std::vector<size_t> last(trace.num_threads, trace.start);
+      auto closeRegions = [&] (size_t i, size_t when)
+      {
+        for ( ; depth[i] > 0; depth[i]--)
+          file << "13 " << fac*(when-trace.start) << " thdstate th" << i << "\n";
+      };
+
+      trace.forEachEvent ([&] (int i, const Event & e)
+      {
+        last[i] = e.when;
+        switch (e.what)
           {
-            auto col = Timer::cols[i];
-            file << "5 timer" << i << " thdstate \"" << Timer::names[i] << "\"  \"" << col[0] << " " << col[1] << " " << col[2] << "\"" << std::endl;
+          case 0:
+            depth[i]++;
+            file << "12 " << fac*(e.when-trace.start) << " thdstate th" << i << " timer" << e.timer << " idx\n";
+            break;
+          case 1:
+            if (depth[i] == 0) break;
+            depth[i]--;
+            file << "13 " << fac*(e.when-trace.start) << " thdstate th" << i << "\n";
+            break;
+          case 2:
+          case 3:
+            // the task spawned on one thread and started on another
+            file << ((e.what==2) ? 15 : 16) << " " << fac*(e.when-trace.start)
+                 << " fork a9 fork th" << i << " " << e.timer << "\n";
+            break;
+          case 4:
+            closeRegions (i, e.when);
+            break;
           }
-        
-        for (int i = 0; i <= subtl.size(); i++)
+      });
+      for (size_t i = 0; i < trace.num_threads; i++)
+        closeRegions (i, last[i]);
+    }
+
+
+    std::string jsonString (const std::string & str)
+    {
+      std::string res = "\"";
+      for (char c : str)
+        {
+          if (c == '"' || c == '\\')
+            res += '\\';
+          if (uint8_t(c) < 0x20)
+            {
+              char hex[8];
+              snprintf (hex, sizeof(hex), "\\u%04x", unsigned(uint8_t(c)));
+              res += hex;
+            }
+          else
+            res += c;
+        }
+      return res + "\"";
+    }
+
+    /*
+      Chrome trace event format, for chrome://tracing and ui.perfetto.dev:
+      https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+      timers are duration events, forks are flow events
+    */
+    void writeChrome (const TraceFile & trace, std::ostream & file)
+    {
+      file << std::fixed << std::setprecision(3);
+      file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+           << "{\"ph\":\"M\",\"pid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"Task Manager\"}}";
+      for (size_t i = 0; i < trace.num_threads; i++)
+        file << ",\n{\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+             << ",\"name\":\"thread_name\",\"args\":{\"name\":\"Thread " << i << "\"}}";
+
+      std::vector<std::string> names;
+      for (auto & name : trace.names)
+        names.push_back (jsonString(name));
+
+      // in microseconds, dropped events handled as for Paje
+      double fac = 1e6 * trace.seconds_per_tick;
+      std::vector<int> depth(trace.num_threads, 0);
+      std::vector<size_t> last(trace.num_threads, trace.start);
+      auto closeRegions = [&] (size_t i, size_t when)
+      {
+        for ( ; depth[i] > 0; depth[i]--)
+          file << ",\n{\"ph\":\"E\",\"pid\":0,\"tid\":" << i << ",\"ts\":" << fac*(when-trace.start) << "}";
+      };
+
+      trace.forEachEvent ([&] (int i, const Event & e)
+      {
+        last[i] = e.when;
+        double ts = fac*(e.when-trace.start);
+        switch (e.what)
           {
-            auto * tl = (i==0) ? this : &subtl[i-1];
-            for (auto e : tl->events)
-              {
-                file << ((e.what==0) ? 12 : 13) << " ";
-                file << fac*(e.when-start) << " thdstate th" << i << " ";
-                if (e.what == 0)
-                  file << "timer" << e.timer << " idx ";
-                file << std::endl;
-              }
+          case 0:
+            depth[i]++;
+            file << ",\n{\"ph\":\"B\",\"pid\":0,\"tid\":" << i << ",\"ts\":" << ts << ",\"name\":"
+                 << (size_t(e.timer) < names.size() ? names[e.timer] : "\"?\"") << "}";
+            break;
+          case 1:
+            if (depth[i] == 0) break;
+            depth[i]--;
+            file << ",\n{\"ph\":\"E\",\"pid\":0,\"tid\":" << i << ",\"ts\":" << ts << "}";
+            break;
+          case 2:
+          case 3:
+            file << ",\n{\"ph\":\"" << ((e.what==2) ? "s" : "f\",\"bp\":\"e")
+                 << "\",\"cat\":\"fork\",\"name\":\"fork\",\"id\":" << uint32_t(e.timer)
+                 << ",\"pid\":0,\"tid\":" << i << ",\"ts\":" << ts << "}";
+            break;
+          case 4:
+            closeRegions (i, e.when);
+            break;
           }
+      });
+      for (size_t i = 0; i < trace.num_threads; i++)
+        closeRegions (i, last[i]);
+      file << "\n]}\n";
+    }
+  }
+
+
+  bool ConvertTrace (const std::string & binary_file, const std::string & outfile, TraceFormat format)
+  {
+    TraceFile trace;
+    if (!trace.read (binary_file))
+      return false;
+
+    std::ofstream file(outfile, std::ios::binary);
+    switch (format)
+      {
+      case TraceFormat::Paje:
+        writePaje (trace, file);
+        break;
+      case TraceFormat::Chrome:
+        writeChrome (trace, file);
+        break;
+      case TraceFormat::Binary:
+        file << std::ifstream(binary_file, std::ios::binary).rdbuf();
+        break;
       }
+    return bool(file);
   }
 
-  
-  
-  void TimeLine :: print (std::ostream & ost) const
+
+
+  Profile :: Profile (ProfileOptions _options)
+    : options(_options), root(this)
+  {
+    entries.reserve(256);
+    if (options.histogram)
+      hist.reserve(256);
+    start_ticks = getTimeCounter();
+    start_time = std::chrono::high_resolution_clock::now();
+    openCounters();
+  }
+
+  Profile :: Profile (Profile & _root)
+    : options(_root.options), root(&_root),
+      start_ticks(_root.start_ticks), start_time(_root.start_time)
+  {
+    entries.reserve(256);
+    if (options.histogram)
+      hist.reserve(256);
+    openCounters();
+  }
+
+  // on the thread which runs the profile
+  void Profile :: openCounters ()
+  {
+    if (!options.hardware_counters) return;
+
+    counters = std::make_unique<HardwareCounters>(options.flop_events);
+    if (root == this)
+      {
+        for (int k = 0; k < HardwareCounters::NUM_COUNTERS; k++)
+          hw_available[k] = counters->available(HardwareCounters::Counter(k));
+        hw_error = counters->errorMessage();
+      }
+    if (counters->active())
+      hw.reserve(256);
+    else
+      counters.reset();
+  }
+
+  Profile :: ~Profile()
+  {
+    if (root == this) return;
+    std::lock_guard<std::mutex> lock(root->merge_mutex);
+    mergeInto (root->merged, root->merged_hist, entries, hist);
+    mergeEntries (root->merged_paths, path_entries);
+    mergeCounters (root->merged_hw, hw);
+    root->merged_too_deep += too_deep;
+  }
+
+  void Profile :: grow (size_t nr)
+  {
+    entries.resize(nr+1);
+    if (options.histogram)
+      hist.resize(nr+1, std::array<size_t,HIST_SIZE>{});
+    if (counters)
+      hw.resize(nr+1, HardwareCounters::Values{});
+  }
+
+  void Profile :: mergeInto (std::vector<Entry> & to, std::vector<std::array<size_t,HIST_SIZE>> & to_hist,
+                             const std::vector<Entry> & from, const std::vector<std::array<size_t,HIST_SIZE>> & from_hist)
+  {
+    mergeEntries (to, from);
+    if (to_hist.size() < from_hist.size())
+      to_hist.resize(from_hist.size(), std::array<size_t,HIST_SIZE>{});
+    for (size_t i = 0; i < from_hist.size(); i++)
+      for (int k = 0; k < HIST_SIZE; k++)
+        to_hist[i][k] += from_hist[i][k];
+  }
+
+  void Profile :: mergeEntries (std::vector<Entry> & to, const std::vector<Entry> & from)
+  {
+    if (to.size() < from.size())
+      to.resize(from.size());
+    for (size_t i = 0; i < from.size(); i++)
+      {
+        to[i].count += from[i].count;
+        to[i].inclusive += from[i].inclusive;
+        to[i].exclusive += from[i].exclusive;
+        to[i].min = std::min(to[i].min, from[i].min);
+        to[i].max = std::max(to[i].max, from[i].max);
+      }
+  }
+
+  void Profile :: mergeCounters (std::vector<HardwareCounters::Values> & to,
+                                 const std::vector<HardwareCounters::Values> & from)
+  {
+    if (to.size() < from.size())
+      to.resize(from.size(), HardwareCounters::Values{});
+    for (size_t i = 0; i < from.size(); i++)
+      for (int k = 0; k < HardwareCounters::NUM_COUNTERS; k++)
+        to[i][k] += from[i][k];
+  }
+
+  std::vector<Profile::Entry> Profile :: statistics()
+  {
+    std::lock_guard<std::mutex> lock(merge_mutex);
+    std::vector<Entry> res = merged;
+    std::vector<std::array<size_t,HIST_SIZE>> res_hist;
+    mergeInto (res, res_hist, entries, {});
+    return res;
+  }
+
+  void Profile :: print (std::ostream & ost)
+  {
+    std::vector<Entry> stats;
+    std::vector<std::array<size_t,HIST_SIZE>> hists;
+    size_t skipped;
+    {
+      std::lock_guard<std::mutex> lock(merge_mutex);
+      stats = merged;
+      hists = merged_hist;
+      skipped = merged_too_deep;
+    }
+    mergeInto (stats, hists, entries, hist);
+    skipped += too_deep;
+
+    std::vector<std::string> names;
+    {
+      std::lock_guard<std::mutex> lock(Timer::m);
+      names = Timer::names;
+    }
+
+    double sec_per_tick =
+      std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-start_time).count()
+      / std::max<double>(1, getTimeCounter()-start_ticks);
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < stats.size(); i++)
+      if (stats[i].count)
+        order.push_back(i);
+    std::sort (order.begin(), order.end(), [&stats] (size_t a, size_t b)
+               { return stats[a].inclusive > stats[b].inclusive; });
+
+    auto precision = ost.precision(4);
+    ost << "timer                                 calls   incl[ms]   excl[ms]    min[us]    avg[us]    max[us]" << std::endl;
+    for (size_t i : order)
+      {
+        auto & s = stats[i];
+        std::string name = (i < names.size()) ? names[i] : "?";
+        if (name.size() > 32)
+          name = name.substr(0, 29) + "...";
+        ost << std::left << std::setw(32) << name << std::right
+            << std::setw(11) << s.count
+            << std::setw(11) << 1e3*sec_per_tick*s.inclusive
+            << std::setw(11) << 1e3*sec_per_tick*s.exclusive
+            << std::setw(11) << 1e6*sec_per_tick*s.min
+            << std::setw(11) << 1e6*sec_per_tick*s.inclusive/s.count
+            << std::setw(11) << 1e6*sec_per_tick*s.max << std::endl;
+
+        if (i < hists.size())
+          {
+            ost << "    2^k cycles:";
+            for (int k = 0; k < HIST_SIZE; k++)
+              if (hists[i][k])
+                ost << " " << k << ":" << hists[i][k];
+            ost << std::endl;
+          }
+      }
+    if (skipped)
+      ost << "profile stack was full, " << skipped << " regions nested deeper than "
+          << MAX_DEPTH << " were not counted" << std::endl;
+
+    if (options.hardware_counters && hw_error != "")
+      ost << "hardware counters not available: " << hw_error << std::endl;
+    else if (options.hardware_counters)
+      {
+        std::vector<HardwareCounters::Values> hws;
+        {
+          std::lock_guard<std::mutex> lock(merge_mutex);
+          hws = merged_hw;
+        }
+        mergeCounters (hws, hw);
+
+        using HC = HardwareCounters;
+        auto column = [&] (bool ok, double value)
+        {
+          if (ok)
+            ost << std::setw(11) << value;
+          else
+            ost << std::setw(11) << "-";
+        };
+
+        ost << "timer                                cycles     instr        IPC    L1 miss   LLC miss    GFlop/s bytes/flop" << std::endl;
+        for (size_t i : order)
+          {
+            if (i >= hws.size()) continue;
+            auto & v = hws[i];
+            std::string name = (i < names.size()) ? names[i] : "?";
+            if (name.size() > 32)
+              name = name.substr(0, 29) + "...";
+            double flops = v[HC::FLOPS];
+            ost << std::left << std::setw(32) << name << std::right;
+            column (hw_available[HC::CYCLES], v[HC::CYCLES]);
+            column (hw_available[HC::INSTRUCTIONS], v[HC::INSTRUCTIONS]);
+            column (hw_available[HC::INSTRUCTIONS] && v[HC::CYCLES],
+                    double(v[HC::INSTRUCTIONS]) / v[HC::CYCLES]);
+            column (hw_available[HC::L1_MISSES], v[HC::L1_MISSES]);
+            column (hw_available[HC::LLC_MISSES], v[HC::LLC_MISSES]);
+            column (hw_available[HC::FLOPS] && stats[i].inclusive,
+                    1e-9 * flops / (sec_per_tick*stats[i].inclusive));
+            column (hw_available[HC::FLOPS] && hw_available[HC::LLC_MISSES] && flops > 0,
+                    64 * v[HC::LLC_MISSES] / flops);
+            ost << std::endl;
+          }
+      }
+    ost.precision(precision);
+  }
+
+
+
+  namespace
+  {
+    // the call-tree nodes of all threads, 0 is the root
+    struct PathTable
+    {
+      std::mutex mutex;
+      std::vector<std::pair<int,int>> nodes { { -1, -1 } };   // parent, timer
+      std::unordered_map<uint64_t,int> ids;
+    };
+
+    PathTable & pathTable()
+    {
+      static PathTable table;
+      return table;
+    }
+
+    uint64_t pathKey (int parent, int nr)
+    {
+      return (uint64_t(uint32_t(parent)) << 32) | uint32_t(nr);
+    }
+  }
+
+  int Profile :: childPath (int parent, int nr)
+  {
+    uint64_t key = pathKey(parent, nr);
+    auto it = path_cache.find(key);
+    if (it != path_cache.end())
+      return it->second;
+
+    auto & table = pathTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    auto [pos, isnew] = table.ids.emplace(key, table.nodes.size());
+    if (isnew)
+      table.nodes.emplace_back(parent, nr);
+    path_cache[key] = pos->second;
+    return pos->second;
+  }
+
+  void Profile :: growPaths (size_t path)
+  {
+    path_entries.resize(std::max(path+1, 2*path_entries.size()));
+  }
+
+  std::vector<Profile::Entry> Profile :: pathStatistics()
   {
-    ost << "ending timeline:" << std::endl;
-    for (auto e : events)
-      ost << e.when-start << ", " << e.timer << ", " << e.what << std::endl;
+    std::lock_guard<std::mutex> lock(merge_mutex);
+    std::vector<Entry> res = merged_paths;
+    mergeEntries (res, path_entries);
+    return res;
+  }
+
+  // "outer;inner" for all paths with calls
+  std::vector<std::string> Profile :: pathNames (size_t num)
+  {
+    std::vector<std::string> names;
+    {
+      std::lock_guard<std::mutex> lock(Timer::m);
+      names = Timer::names;
+    }
+    for (auto & name : names)
+      std::replace (name.begin(), name.end(), ';', ',');
+
+    auto & table = pathTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    std::vector<std::string> res(std::min(num, table.nodes.size()));
+    for (size_t i = 1; i < res.size(); i++)
+      {
+        auto [parent, nr] = table.nodes[i];     // parents come first
+        std::string name = (size_t(nr) < names.size()) ? names[nr] : "?";
+        res[i] = (parent > 0) ? res[parent] + ";" + name : name;
+      }
+    return res;
+  }
+
+  void Profile :: writeCollapsedStacks (std::ostream & ost)
+  {
+    auto stats = pathStatistics();
+    auto names = pathNames(stats.size());
+    double ns_per_tick =
+      1e9 * std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-start_time).count()
+      / std::max<double>(1, getTimeCounter()-start_ticks);
+
+    for (size_t i = 1; i < names.size(); i++)
+      if (stats[i].count)
+        ost << names[i] << " " << size_t(ns_per_tick*stats[i].exclusive) << "\n";
+  }
+
+  void Profile :: printHotspots (std::ostream & ost, int n)
+  {
+    auto stats = pathStatistics();
+    auto names = pathNames(stats.size());
+    double sec_per_tick =
+      std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-start_time).count()
+      / std::max<double>(1, getTimeCounter()-start_ticks);
+
+    std::vector<size_t> order;
+    for (size_t i = 1; i < names.size(); i++)
+      if (stats[i].count)
+        order.push_back(i);
+    std::sort (order.begin(), order.end(), [&stats] (size_t a, size_t b)
+               { return stats[a].exclusive > stats[b].exclusive; });
+    if (order.size() > size_t(n))
+      order.resize(n);
+
+    auto precision = ost.precision(4);
+    ost << "  excl[ms]   incl[ms]      calls  path" << std::endl;
+    for (size_t i : order)
+      ost << std::setw(10) << 1e3*sec_per_tick*stats[i].exclusive
+          << std::setw(11) << 1e3*sec_per_tick*stats[i].inclusive
+          << std::setw(11) << stats[i].count
+          << "  " << names[i] << std::endl;
+    ost.precision(precision);
+  }
+
+
+
+  std::vector<FlopEvent> DefaultFlopEvents()
+  {
+#if (defined(__amd64__) || defined(_M_AMD64)) && defined(__GNUC__)
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+      {
+        char vendor[13];
+        memcpy (vendor, &ebx, 4);
+        memcpy (vendor+4, &edx, 4);
+        memcpy (vendor+8, &ecx, 4);
+        vendor[12] = 0;
+
+        // FP_ARITH_INST_RETIRED scalar, 128, 256, 512 bit packed double, FMA counts twice
+        if (strcmp(vendor, "GenuineIntel") == 0)
+          return { { 0x01c7, 1 }, { 0x04c7, 2 }, { 0x10c7, 4 }, { 0x40c7, 8 } };
+        // FP_RET_SSE_AVX_OPS all, counts flops (Zen 2 and later)
+        if (strcmp(vendor, "AuthenticAMD") == 0)
+          return { { 0xff03, 1 } };
+      }
+#endif
+    return { };
+  }
+
+
+#ifdef __linux__
+  static int perfEventOpen (uint32_t type, uint64_t config, int group_fd)
+  {
+    perf_event_attr attr;
+    memset (&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = (group_fd == -1);   // leaders start when the group is complete
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // this thread, any cpu
+    return syscall (SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+  }
+#endif
+
+  HardwareCounters :: HardwareCounters (const std::vector<FlopEvent> & flop_events)
+  {
+#ifdef __linux__
+    group[0] = perfEventOpen (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (group[0] < 0)
+      {
+        error = strerror(errno);
+        return;
+      }
+    members.push_back (CYCLES);
+
+    struct { Counter counter; uint32_t type; uint64_t config; } events[] =
+      {
+        { INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { L1_MISSES, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+      };
+    for (auto & e : events)
+      {
+        int fd = perfEventOpen (e.type, e.config, group[0]);
+        if (fd < 0) continue;
+        fds.push_back (fd);
+        members.push_back (e.counter);
+      }
+
+    for (auto & e : flop_events)
+      {
+        if (weights.size() == MAX_GROUP) break;
+        int fd = perfEventOpen (PERF_TYPE_RAW, e.config, group[1]);
+        if (fd < 0) continue;
+        if (group[1] < 0)
+          group[1] = fd;
+        else
+          fds.push_back (fd);
+        weights.push_back (e.flops);
+      }
+
+    for (int g : group)
+      if (g >= 0)
+        ioctl (g, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+    error = "needs Linux perf_event_open";
+#endif
+  }
+
+  HardwareCounters :: ~HardwareCounters()
+  {
+#ifdef __linux__
+    for (int fd : fds)
+      close (fd);
+    for (int g : group)
+      if (g >= 0)
+        close (g);
+#endif
+  }
+
+  bool HardwareCounters :: available (Counter c) const
+  {
+    if (c == FLOPS)
+      return !weights.empty();
+    return std::find (members.begin(), members.end(), c) != members.end();
+  }
+
+  void HardwareCounters :: read (Values & values) const
+  {
+    values = Values{};
+#ifdef __linux__
+    // nr, time enabled, time running, values
+    uint64_t buf[3+MAX_GROUP];
+    for (int g = 0; g < 2; g++)
+      {
+        if (group[g] < 0 || ::read (group[g], buf, sizeof(buf)) <= 0)
+          continue;
+        // the kernel multiplexes when there are too few hardware counters
+        double scale = (buf[2] == buf[1]) ? 1 : (buf[2] > 0) ? double(buf[1]) / buf[2] : 0;
+        if (g == 0)
+          for (size_t i = 0; i < members.size() && i < buf[0]; i++)
+            values[members[i]] = uint64_t(scale * buf[3+i]);
+        else
+          {
+            double flops = 0;
+            for (size_t i = 0; i < weights.size() && i < buf[0]; i++)
+              flops += weights[i] * buf[3+i];
+            values[FLOPS] = uint64_t(scale * flops);
+          }
+      }
+#endif
   }
 }
@@ -11,6 +11,11 @@
 #include <thread>
 #include <functional>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <unordered_map>
+#include <fstream>
 
 
 
@@ -69,40 +74,420 @@ namespace ASC_HPC
   struct Event
   {
     size_t when;
-    int timer;
-    int what; // 0..start, 1..stop
+    int timer;  // timer number, or the key of a link
+    int what; // 0..start, 1..stop, 2..link start, 3..link end,
+              // 4..events of the thread before were lost (trace files only)
   };
 
 
+  // what a thread's full event buffer does when the writer doesn't keep up
+  enum class TraceOverflow
+  {
+    DropOldest,  // overwrite the oldest unwritten events
+    Sample       // keep the old events, drop whole new regions until there is room
+  };
+
+  enum class TraceFormat
+  {
+    Paje,     // for ViTE, converted at the end
+    Chrome,   // trace event JSON for chrome://tracing and ui.perfetto.dev, converted at the end
+    Binary    // the compact file as written while running, convert later with ConvertTrace
+  };
+
+  struct TraceOptions
+  {
+    size_t capacity = 1 << 16;     // events per thread, rounded up to a power of 2
+    TraceOverflow overflow = TraceOverflow::DropOldest;
+    int flush_interval_ms = 10;    // the writer drains all buffers that often
+    TraceFormat format = TraceFormat::Paje;
+  };
+
+  // binary trace to Paje or Chrome JSON, false if binary_file is no binary trace
+  bool ConvertTrace (const std::string & binary_file, const std::string & outfile,
+                     TraceFormat format);
+
+
+  /*
+    fixed-size event buffer of one thread. The owner pushes, the writer
+    thread drains. Slots are relaxed atomics: with DropOldest the owner
+    may overwrite a slot the writer is copying, the writer then finds the
+    tail moved and discards what it read (seqlock style).
+  */
+  class EventRing
+  {
+    struct Slot
+    {
+      std::atomic<size_t> when;
+      std::atomic<uint64_t> timer_what;
+    };
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    TraceOverflow overflow;
+
+    alignas(64) std::atomic<size_t> head{0};   // next to write, owner only
+    size_t tail_cache = 0;
+    int skip_level = 0;                        // Sample: nesting level of a dropped region
+    alignas(64) std::atomic<size_t> tail{0};   // next to drain
+    std::atomic<size_t> dropped{0};
+    size_t drained = 0;                        // writer only: where the last drain ended
+
+  public:
+    EventRing (size_t capacity, TraceOverflow _overflow);
+
+    void push (Event e)
+    {
+      size_t h = head.load(std::memory_order_relaxed);
+      if (h - tail_cache > mask/2)
+        tail_cache = tail.load(std::memory_order_acquire);
+
+      if (overflow == TraceOverflow::Sample)
+        {
+          // starts and links need half of the buffer free, stops may use the rest
+          size_t limit = (e.what == 1) ? mask : mask/2;
+          if (skip_level > 0 || (e.what == 0 && h - tail_cache > limit))
+            {
+              if (e.what == 0) skip_level++;
+              if (e.what == 1) skip_level--;
+              dropped.store(dropped.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+              return;
+            }
+          if (h - tail_cache > limit)
+            {
+              dropped.store(dropped.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+              return;
+            }
+        }
+      else if (h - tail_cache > mask)
+        {
+          // advance the tail past the oldest event, unless the writer did already
+          while (h - tail_cache > mask)
+            if (tail.compare_exchange_weak(tail_cache, h-mask, std::memory_order_acq_rel))
+              {
+                dropped.store(dropped.load(std::memory_order_relaxed)+h-mask-tail_cache,
+                              std::memory_order_relaxed);
+                tail_cache = h-mask;
+              }
+          std::atomic_thread_fence(std::memory_order_release);
+        }
+
+      Slot & slot = slots[h & mask];
+      slot.when.store(e.when, std::memory_order_relaxed);
+      slot.timer_what.store((uint64_t(uint32_t(e.timer)) << 32) | uint32_t(e.what),
+                            std::memory_order_relaxed);
+      head.store(h+1, std::memory_order_release);
+    }
+
+    // writer only: appends up to max events, returns how many were taken
+    // off the buffer. lost tells if events were dropped before them
+    size_t drain (std::vector<Event> & out, size_t max, bool & lost);
+    size_t numDropped() const { return dropped.load(std::memory_order_relaxed); }
+  };
+
+
+  /*
+    events of one thread. The TimeLine with a filename is the root: it
+    owns a writer thread which drains the buffers of all threads in
+    chunks to the binary trace filename.events while the program runs.
+    When the root is destroyed, that file is finished and renamed, or
+    converted to Paje or Chrome JSON. Memory stays at capacity events
+    per thread. TimeLines of other threads are created from the root.
+  */
   class TimeLine
   {
     size_t start;
     std::chrono::time_point<std::chrono::high_resolution_clock> start_time;
-    std::vector<Event> events;
-    std::vector<TimeLine> subtl;
-    static std::mutex timeline_mutex;
     std::string filename;
+    TraceOptions options;
+    TimeLine * root;
+    std::shared_ptr<EventRing> ring;
+
+    // root only
+    std::mutex rings_mutex;
+    std::vector<std::shared_ptr<EventRing>> rings;
+    std::thread writer;
+    std::mutex writer_mutex;
+    std::condition_variable writer_cv;
+    bool stop_writer = false;
+    std::ofstream spool;
+    std::vector<size_t> last_when;   // per thread, for delta encoding
+
+    void registerRing (std::shared_ptr<EventRing> ring);
+    void writeEvents ();
   public:
-    TimeLine(std::string _filename = "");
-    TimeLine(const TimeLine&) = default;    
-    TimeLine(TimeLine&&) = default;
+    TimeLine (std::string _filename = "", TraceOptions _options = TraceOptions());
+    TimeLine (TimeLine & _root);   // for another thread, written by the root
+    TimeLine (const TimeLine&) = delete;
     ~TimeLine();
     
     void add (Event event)
     {
-      events.push_back(event);
+      ring->push(event);
     }
+  };
+  
+  extern thread_local std::unique_ptr<TimeLine> timeline;
+
+
+  inline int log2Floor (uint64_t x)
+  {
+#if defined(__GNUC__)
+    return 63-__builtin_clzll(x|1);
+#else
+    int k = 0;
+    while (x >>= 1) k++;
+    return k;
+#endif
+  }
+
+  // a raw perf event counting floating point instructions, flops per count
+  struct FlopEvent
+  {
+    uint64_t config;
+    double flops;
+  };
+
+  // double precision FP_ARITH_INST_RETIRED on Intel, FP_RET_SSE_AVX_OPS on AMD, else none
+  std::vector<FlopEvent> DefaultFlopEvents();
 
-    void addTimeLine (TimeLine sub)
+  /*
+    hardware counters of the calling thread, through Linux perf_event_open,
+    user space only. Counters which can't be opened (other OS, no PMU in
+    the VM, perf_event_paranoid > 2, unknown event) are not available and
+    read 0. Counts are scaled up if the kernel multiplexes the counters.
+  */
+  class HardwareCounters
+  {
+  public:
+    enum Counter { CYCLES, INSTRUCTIONS, L1_MISSES, LLC_MISSES, FLOPS, NUM_COUNTERS };
+    using Values = std::array<uint64_t,NUM_COUNTERS>;
+
+  private:
+    int group[2] = { -1, -1 };     // leaders of cycles ... LLC misses, of the flop events
+    std::vector<int> fds;          // the other members
+    std::vector<Counter> members;  // of group 0, in read order
+    std::vector<double> weights;   // of group 1
+    std::string error;
+    static constexpr size_t MAX_GROUP = 8;
+
+  public:
+    HardwareCounters (const std::vector<FlopEvent> & flop_events = DefaultFlopEvents());
+    HardwareCounters (const HardwareCounters&) = delete;
+    ~HardwareCounters();
+
+    bool active() const { return group[0] >= 0; }
+    bool available (Counter c) const;
+    // why not active
+    const std::string & errorMessage() const { return error; }
+
+    // counts since construction
+    void read (Values & values) const;
+  };
+
+
+  struct ProfileOptions
+  {
+    bool histogram = false;   // per timer, counts of region lengths in 2^k cycles
+    bool calltree = false;    // statistics per path of nested timers as well
+    // per timer HardwareCounters, costs two system calls per start and stop
+    bool hardware_counters = false;
+    std::vector<FlopEvent> flop_events = DefaultFlopEvents();
+  };
+
+  /*
+    statistics-only profiling: per timer count, inclusive and exclusive
+    time, shortest and longest region, no event log.
+
+      profile = std::make_unique<Profile>();
+      StartWorkers(3);    // workers count into their own Profile,
+      ...
+      StopWorkers();      // merged into ours when they stop
+      profile->print(std::cout);
+
+    Updates touch only the thread's own counters and don't allocate
+    (below 256 timers). Exclusive time is the inclusive time minus the
+    timed regions directly nested inside, on the same thread. Regions
+    nested deeper than 64 are not counted, print tells how many.
+
+    With hardware_counters, print adds cycles, instructions, cache misses
+    and flops of each timer (inclusive), with IPC, GFlop/s per thread
+    and bytes per flop, estimated as 64 bytes per LLC miss.
+
+    With calltree, every path of nested timers, as "solve;assemble;element",
+    is counted separately. A task continues the path of the region
+    which spawned it, on whichever thread it runs. Paths are merged
+    over threads, so the children of a region running in parallel may
+    sum up to more than its inclusive time.
+  */
+  class Profile
+  {
+  public:
+    struct Entry
+    {
+      size_t count = 0;
+      size_t inclusive = 0;    // ticks of getTimeCounter
+      size_t exclusive = 0;
+      size_t min = SIZE_MAX;
+      size_t max = 0;
+    };
+    static constexpr int HIST_SIZE = 64;
+
+  private:
+    struct Frame
+    {
+      size_t start;
+      size_t children;    // inclusive time of nested regions
+      int path;           // call-tree node, 0 is the root
+      HardwareCounters::Values hw_start;
+    };
+    static constexpr int MAX_DEPTH = 64;
+    Frame stack[MAX_DEPTH];
+    int depth = 0;
+    size_t too_deep = 0;    // regions nested deeper than MAX_DEPTH, not counted
+
+    ProfileOptions options;
+    Profile * root;
+    std::vector<Entry> entries;
+    std::vector<std::array<size_t,HIST_SIZE>> hist;
+    std::vector<Entry> path_entries;
+    std::unordered_map<uint64_t,int> path_cache;   // (parent, timer) -> path
+    std::unique_ptr<HardwareCounters> counters;    // if hardware_counters and active
+    std::vector<HardwareCounters::Values> hw;
+
+    // root only
+    size_t start_ticks;
+    std::chrono::time_point<std::chrono::high_resolution_clock> start_time;
+    std::mutex merge_mutex;
+    std::vector<Entry> merged;
+    std::vector<std::array<size_t,HIST_SIZE>> merged_hist;
+    std::vector<Entry> merged_paths;
+    std::vector<HardwareCounters::Values> merged_hw;
+    size_t merged_too_deep = 0;
+    std::array<bool,HardwareCounters::NUM_COUNTERS> hw_available{};
+    std::string hw_error;
+
+    void openCounters();
+
+    void grow (size_t nr);
+    void growPaths (size_t path);
+    int childPath (int parent, int nr);
+    std::vector<Entry> pathStatistics();
+    static std::vector<std::string> pathNames (size_t num);
+    static void mergeEntries (std::vector<Entry> & to, const std::vector<Entry> & from);
+    static void mergeCounters (std::vector<HardwareCounters::Values> & to,
+                               const std::vector<HardwareCounters::Values> & from);
+    static void mergeInto (std::vector<Entry> & to, std::vector<std::array<size_t,HIST_SIZE>> & to_hist,
+                           const std::vector<Entry> & from, const std::vector<std::array<size_t,HIST_SIZE>> & from_hist);
+  public:
+    Profile (ProfileOptions _options = ProfileOptions());
+    Profile (Profile & _root);   // for another thread, merged into the root when destroyed
+    Profile (const Profile&) = delete;
+    ~Profile();
+
+    void start (int nr)
+    {
+      int path = 0;
+      if (options.calltree)
+        path = childPath (currentPath(), nr);
+      if (depth < MAX_DEPTH)
+        {
+          Frame & f = stack[depth];
+          if (counters)
+            counters->read(f.hw_start);
+          f.start = getTimeCounter();
+          f.children = 0;
+          f.path = path;
+        }
+      depth++;
+    }
+
+    void stop (int nr)
+    {
+      size_t now = getTimeCounter();
+      if (depth == 0) return;    // started before the profile was
+      depth--;
+      if (depth >= MAX_DEPTH)
+        {
+          too_deep++;
+          return;
+        }
+
+      size_t time = now - stack[depth].start;
+      if (depth > 0)
+        stack[depth-1].children += time;
+
+      if (size_t(nr) >= entries.size())
+        grow (nr);
+      Entry & e = entries[nr];
+      e.count++;
+      e.inclusive += time;
+      e.exclusive += time - stack[depth].children;
+      e.min = std::min(e.min, time);
+      e.max = std::max(e.max, time);
+      if (options.histogram)
+        hist[nr][log2Floor(time)]++;
+
+      if (counters)
+        {
+          HardwareCounters::Values values;
+          counters->read(values);
+          for (int k = 0; k < HardwareCounters::NUM_COUNTERS; k++)
+            hw[nr][k] += values[k] - stack[depth].hw_start[k];
+        }
+
+      if (options.calltree)
+        {
+          int path = stack[depth].path;
+          if (size_t(path) >= path_entries.size())
+            growPaths (path);
+          Entry & pe = path_entries[path];
+          pe.count++;
+          pe.inclusive += time;
+          pe.exclusive += time - stack[depth].children;
+          pe.min = std::min(pe.min, time);
+          pe.max = std::max(pe.max, time);
+        }
+    }
+
+    int currentPath () const
+    {
+      return (depth > 0) ? stack[std::min(depth, MAX_DEPTH)-1].path : 0;
+    }
+
+    // a task spawned in path runs on this thread, used by the task manager
+    void enterTask (int path)
     {
-      std::lock_guard<std::mutex> lock(timeline_mutex);      
-      subtl.push_back(std::move(sub));
+      if (depth < MAX_DEPTH)
+        {
+          stack[depth].start = 0;
+          stack[depth].children = 0;
+          stack[depth].path = path;
+        }
+      depth++;
     }
 
-    void print (std::ostream & ost) const;
+    void leaveTask ()
+    {
+      if (depth == 0) return;
+      depth--;
+      // regions of a task run inline are nested into ours
+      if (depth > 0 && depth < MAX_DEPTH)
+        stack[depth-1].children += stack[depth].children;
+    }
+
+    // of the root's thread and all merged threads, indexed by timer number.
+    // Call from the root's thread
+    std::vector<Entry> statistics();
+    // a table sorted by inclusive time
+    void print (std::ostream & ost);
+
+    // call tree only, call from the root's thread:
+    // "path exclusive-nanoseconds" per line, the input of flamegraph.pl
+    void writeCollapsedStacks (std::ostream & ost);
+    // the n paths with the most exclusive time
+    void printHotspots (std::ostream & ost, int n = 10);
   };
-  
-  extern thread_local std::unique_ptr<TimeLine> timeline;
+
+  extern thread_local std::unique_ptr<Profile> profile;
 
   
   class Timer
@@ -122,16 +507,21 @@ namespace ASC_HPC
 
     void start()
     {
+      if (profile)
+        profile->start(nr);
       if (timeline)
         timeline->add (Event{getTimeCounter(), nr, 0});
     }
 
     void stop()
     {
+      if (profile)
+        profile->stop(nr);
       if (timeline)
         timeline->add(Event{getTimeCounter(), nr, 1});
     }
     friend TimeLine;
+    friend Profile;
   };
 
 